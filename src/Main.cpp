@@ -1,11 +1,12 @@
 #include <vd/ImageFormats.h>
 #include <vd/Options.h>
+#include <vd/Planning.h>
+#include <vd/ThreadPool.h>
 #include <vd/VideoStream.h>
 
 #include <algorithm>
+#include <functional>
 #include <future>
-#include <limits>
-#include <semaphore>
 
 using namespace std::chrono_literals;
 using namespace vd;
@@ -13,21 +14,35 @@ using namespace vd;
 namespace
 {
 
-using Semaphore =
-    std::counting_semaphore<std::numeric_limits<decltype(Options::numThreads)>::max()>;
-
 struct ThreadContext final
 {
     std::shared_ptr<SourceBase> source;
-    Semaphore &semaphore;
+    std::shared_ptr<const ProbedMedia> probed;
     Options options;
-    std::size_t segIdx;
+    std::size_t decoderThreads;
+    //Stream of each worker is kept between its tasks and used by it only
+    std::vector<std::optional<VideoStream>> streams;
+};
+
+struct OpenedSource final
+{
+    std::shared_ptr<SourceBase> source;
+    std::function<CacheStats()> getStats;
+    //Background fetch of metadata, it never fails
+    std::future<void> prefetch;
+    //Empty if probing results aren't persisted
+    std::filesystem::path probedPath;
 };
 
 
 
-std::shared_ptr<SourceBase> OpenSource(const Options &options);
-std::future<void> LaunchThread(ThreadContext ctx);
+OpenedSource OpenSource(const Options &options);
+std::shared_ptr<const ProbedMedia> ProbeSource(std::shared_ptr<SourceBase> source,
+                                               const std::filesystem::path &probedPath);
+std::future<void> SubmitTask(ThreadPool &pool,
+                             std::size_t worker,
+                             std::shared_ptr<ThreadContext> ctx,
+                             DecodeTask task);
 int SafeWait(std::vector<std::future<void>> &futures) noexcept;
 
 }
@@ -36,8 +51,9 @@ int SafeWait(std::vector<std::future<void>> &futures) noexcept;
 
 int main(int argc, char *argv[])
 {
-    auto semaphore = std::optional<Semaphore>{};
+    auto pool = std::optional<ThreadPool>{};
     auto futures = std::vector<std::future<void>>{};
+    auto getStats = std::function<CacheStats()>{};
     int err = 0;
 
     //This block is needed to guarantee that deferred lambda executed before return
@@ -59,19 +75,50 @@ int main(int argc, char *argv[])
                 return 0;
             }
 
-            //It's for exception safety of push_back. Has to be placed before async
-            futures.reserve(options->segments.size());
-            semaphore.emplace(options->numThreads);
+            auto [source, stats, prefetch, probedPath] = OpenSource(*options);
+            if(options->printStats)
+            {
+                getStats = std::move(stats);
+            }
 
-            auto source = OpenSource(*options);
+            //Container is probed once for all segments
+            auto probed = ProbeSource(source, probedPath);
+
+            //Frames of all segments are decoded GOP by GOP, so GOPs shared
+            //by segments are decoded once and long segments are decoded by
+            //several workers
+            auto tasks = PlanDecoding(options->segments,
+                                      GetKeyframeTimestamps(*probed),
+                                      options->numThreads);
+
+            //It's for exception safety of push_back. Has to be placed before
+            //submitting
+            futures.reserve(tasks.size() + 1);
+
+            //Few tasks leave cores to decoders of their workers
+            auto numWorkers = std::min(options->numThreads, tasks.size());
+            auto decoderThreads = options->decoderThreads != 0
+                                      ? options->decoderThreads
+                                      : CalcDecoderThreads(numWorkers, GetNumCores());
+            auto ctx = std::make_shared<ThreadContext>(ThreadContext{ .source = source,
+                                                                      .probed = probed,
+                                                                      .options = *options,
+                                                                      .decoderThreads = decoderThreads,
+                                                                      .streams = {} });
+            ctx->streams.resize(numWorkers);
+            pool.emplace(numWorkers);
+
+            //Every worker gets contiguous range of tasks, so its stream moves
+            //forward unless tasks are stolen by idle workers
+            for(std::size_t idx = 0; idx < tasks.size(); ++idx)
+            {
+                auto worker = idx*numWorkers/tasks.size();
+                futures.push_back(SubmitTask(*pool, worker, ctx, std::move(tasks[idx])));
+            }
 
-            for(std::size_t idx = 0; idx < options->segments.size(); ++idx)
+            if(prefetch.valid())
             {
-                auto ctx = ThreadContext{ .source = source,
-                                          .semaphore = *semaphore,
-                                          .options = *options,
-                                          .segIdx = idx };
-                futures.push_back(LaunchThread(std::move(ctx)));
+                futures.push_back(std::move(prefetch));
             }
         
         }
@@ -82,128 +129,284 @@ int main(int argc, char *argv[])
         }
     }
 
+    //Statistics are complete only when all threads are finished
+    if(getStats)
+    {
+        auto stats = getStats();
+        Printf("downloaded {} bytes, consumed {} bytes\n", stats.fetchedBytes, stats.consumedBytes);
+    }
+
     return err;
 }
 
 namespace
 {
 
-void ThreadMain(ThreadContext &ctx);
+void RunTask(ThreadContext &ctx, const DecodeTask &task, std::size_t worker);
 
-std::future<void> LaunchThread(ThreadContext ctx)
+std::future<void> SubmitTask(ThreadPool &pool,
+                             std::size_t worker,
+                             std::shared_ptr<ThreadContext> ctx,
+                             DecodeTask task)
 {
     return
-        std::async(
-            [ctx = std::move(ctx)]() mutable
+        pool.Submit(
+            worker,
+            [ctx = std::move(ctx), task = std::move(task)](std::size_t runningWorker)
             {
-                ThreadMain(ctx);
+                RunTask(*ctx, task, runningWorker);
             });
 }
 
+//Number of chunks fetched in background by each sequentially reading thread
+const std::size_t cReadAheadChunks = 2;
+//Granularity of chunk fills, it's small enough for box headers parsed by
+//demuxer not to pull whole chunks
+const std::size_t cSectorSize = 1 << 16;
+//Number of chunk buffers kept for reuse when cache cycles, while budget has
+//room for them
+const std::size_t cMaxFreeBuffers = 8;
+//Box headers preceding media data of MP4 are expected to fit into it
+const std::size_t cMp4ProbeSize = 1 << 12;
+//Longer metadata at the end of MP4 isn't kept whole in cache
+const std::size_t cMaxTrailingMetadataChunks = 8;
+//Stored next to disk cache blocks of content
+const auto cProbedMediaFileName = std::string_view{"probed"};
+
+//Number of chunks is limited by memory budget only. Sequential decoding of
+//segments mustn't flush chunks shared by threads, so scan resistant policy
+//is used
 template <SourceConcept SourceT>
-std::shared_ptr<SourceBase> MakeSource(const std::string &url,
-                                       std::size_t numChunks,
-                                       std::size_t chunkSize)
+OpenedSource MakeSource(SourceT source,
+                        std::size_t chunkSize,
+                        std::size_t readAhead,
+                        std::shared_ptr<MemoryBudget> budget)
 {
-    return
-        std::shared_ptr<SourceBase>{
-            new Source{
-                CachedSource{
-                    SourceT{url}, numChunks, chunkSize}}};
+    using Cached = CachedSource<SourceT, TwoQueuePolicy>;
+
+    auto arena = std::make_shared<ChunkArena>(chunkSize, cMaxFreeBuffers, true, budget);
+    auto cached =
+        Cached{std::move(source), 0, chunkSize, readAhead, std::move(budget), cSectorSize, std::move(arena)};
+
+    //Container metadata (e.g. moov atom) usually resides either at the
+    //beginning or at the end and it's needed by every seek
+    auto length = cached.GetContentLength();
+    auto tail = length > 0 ? length - 1 : 0;
+    auto isTailProbed = false;
+    if(length > 0)
+    {
+        cached.Pin(0, 1);
+
+        //Demuxer would find moov behind media data only after reading head,
+        //so it's fetched in background right away
+        auto head = cached.View(0, std::min({length, chunkSize, cMp4ProbeSize}));
+        auto metadataPos = head ? FindTrailingMp4Metadata(head->data, length) : std::nullopt;
+        if(metadataPos && length - *metadataPos <= cMaxTrailingMetadataChunks*chunkSize)
+        {
+            tail = *metadataPos;
+            isTailProbed = true;
+        }
+
+        cached.Pin(tail, length - tail);
+    }
+
+    auto wrapped = std::make_shared<Source<Cached>>(std::move(cached));
+    auto prefetch = std::future<void>{};
+    if(isTailProbed)
+    {
+        prefetch =
+            std::async(
+                std::launch::async,
+                [wrapped, tail, length]() noexcept
+                {
+                    //Demand reads retry anyway
+                    try
+                    {
+                        wrapped->Get().Prefetch(tail, length - tail, FetchPriority::Metadata);
+                    }
+                    catch(...) {}
+                });
+    }
+
+    return OpenedSource{.source = wrapped,
+                        .getStats =
+                            [wrapped]()
+                            {
+                                return wrapped->Get().GetStats();
+                            },
+                        .prefetch = std::move(prefetch),
+                        .probedPath = {}};
 }
 
 
-std::shared_ptr<SourceBase> OpenSource(const std::string &url,
-                                       std::size_t numChunks,
-                                       std::size_t chunkSize)
+OpenedSource OpenSource(const Options &options,
+                        std::shared_ptr<MemoryBudget> budget)
 {
-    std::shared_ptr<SourceBase> res;
+    auto http = std::optional<HttpSource>{};
 
     try
     {
-        res = MakeSource<HttpSource>(url, numChunks, chunkSize);
+        //First chunk is received on connection and lent to cache, every
+        //stream starts reading from there
+        http.emplace(options.videoUrl,
+                     options.numConnections,
+                     HttpSource::cDefaultMemoryLimit,
+                     budget,
+                     options.chunkSize);
     }
     catch(...)
     {
-        res = MakeSource<FileSource>(url, numChunks, chunkSize);
+        //Memory of mapped file is lent directly, so there is nothing to win
+        //by fetching it in background
+        return MakeSource(MappedFileSource{options.videoUrl}, options.chunkSize, 0, std::move(budget));
+    }
+
+    if(options.cacheDir.empty())
+    {
+        return MakeSource(std::move(*http), options.chunkSize, cReadAheadChunks, std::move(budget));
+    }
+
+    //Blocks of disk cache correspond to chunks, so every chunk is loaded
+    //from single file. Sector fills load or fetch only their part of it,
+    //chunks are stored once they're filled as whole
+    auto disk = DiskCachedSource{std::move(*http),
+                                 options.cacheDir,
+                                 options.cacheSize,
+                                 options.chunkSize};
+    if(!disk.IsPersistent())
+    {
+        Errorf("cache directory \"{}\" isn't usable, content isn't cached on disk\n", options.cacheDir.string());
     }
+    auto probedPath = disk.GetSidecarPath(cProbedMediaFileName);
 
+    auto res = MakeSource(std::move(disk), options.chunkSize, cReadAheadChunks, std::move(budget));
+    res.probedPath = std::move(probedPath);
     return res;
 }
 
 VideoStream OpenStream(std::shared_ptr<SourceBase> source,
-                       const Options &options);
+                       std::shared_ptr<const ProbedMedia> probed,
+                       const Options &options,
+                       std::size_t decoderThreads);
 void SaveFrame(std::filesystem::path path, const Frame &frame);
 std::filesystem::path MakePath(std::string_view pattern,
                                std::size_t segIndex,
                                std::size_t frameIndex,
                                Nanoseconds timestamp);
 
-void ThreadMain(ThreadContext &ctx)
+void DecodeFrames(VideoStream &stream, const DecodeTask &task, const Options &options)
 {
-    ctx.semaphore.acquire();
-    Defer release{
-        [&ctx]()
-        {
-            ctx.semaphore.release();
-        }};
+    auto frame = std::optional<Frame>{};
+    auto timestamp = std::optional<Nanoseconds>{};
 
-    auto stream = OpenStream(ctx.source, ctx.options);
-
-    auto seg = ctx.options.segments[ctx.segIdx];
-    auto interval = (seg.to - seg.from) / (seg.numFrames + 1ll);
-    //== 0 is very extreme case but still possible
-    if(interval <= 0ns)
+    for(const auto &target : task.targets)
     {
-        throw Error{std::format("too many frames ({}) requested in segment",
-                                seg.numFrames)};
+        //Segments may request the same timestamp, such frame is decoded once
+        if(target.timestamp != timestamp)
+        {
+            frame = stream.NextFrame(target.timestamp).value();
+            timestamp = target.timestamp;
+        }
+
+        auto path = MakePath(options.format,
+                             target.segIdx + 1,
+                             target.frameIdx + 1,
+                             target.timestamp);
+        SaveFrame(path, *frame);
     }
+}
 
-    auto numFrames = seg.numFrames + 2ll;
-    for(std::int64_t frameIdx = 0; frameIdx < numFrames; ++frameIdx)
+void RunTask(ThreadContext &ctx, const DecodeTask &task, std::size_t worker)
+{
+    auto &stream = ctx.streams[worker];
+
+    try
     {
-        auto timestamp = seg.from + interval*frameIdx;
+        if(!stream)
+        {
+            stream.emplace(OpenStream(ctx.source, ctx.probed, ctx.options, ctx.decoderThreads));
+        }
 
-        auto frame = stream.NextFrame(timestamp).value();
-        
-        auto path = MakePath(ctx.options.format,
-                             ctx.segIdx + 1,
-                             IntCast<std::size_t>(frameIdx + 1),
-                             timestamp);
-        SaveFrame(path, frame);
+        DecodeFrames(*stream, task, ctx.options);
+    }
+    catch(...)
+    {
+        //State of stream is unknown after failure, so next task of worker
+        //opens it again
+        stream.reset();
+        throw;
     }
 }
 
-VideoStream OpenStream(std::shared_ptr<SourceBase> source,
-                       const Options &options)
+ReaderFactory MakeReaderFactory(std::shared_ptr<SourceBase> source)
 {
-    OpeningParams params;
-    params.skipNonRef = options.skipping;
-
-    auto factory =
-        [&source]()
+    return
+        [source = std::move(source)]()
         {
             return
                 std::make_unique<libav::Reader>(
                     source,
                     libav::Reader::SeekSizeMode::Cache);
         };
+}
+
+std::shared_ptr<const ProbedMedia> ProbeSource(std::shared_ptr<SourceBase> source,
+                                               const std::filesystem::path &probedPath)
+{
+    if(probedPath.empty())
+    {
+        return ProbeMediaSource(MakeReaderFactory(std::move(source)));
+    }
+
+    //Streams of content probed by previous runs are opened without
+    //analyzing them and reading index again
+    if(auto probed = LoadProbedMedia(probedPath))
+    {
+        return probed;
+    }
+
+    auto probed = ProbeMediaSource(MakeReaderFactory(std::move(source)));
+    try
+    {
+        SaveProbedMedia(probedPath, *probed);
+    }
+    catch(...)
+    {
+        //Content is just probed again on next run
+    }
+
+    return probed;
+}
+
+VideoStream OpenStream(std::shared_ptr<SourceBase> source,
+                       std::shared_ptr<const ProbedMedia> probed,
+                       const Options &options,
+                       std::size_t decoderThreads)
+{
+    OpeningParams params;
+    params.skipNonRef = options.skipping;
+    params.probed = std::move(probed);
+    params.decoderThreads = decoderThreads;
+    params.decoderName = options.decoder;
 
-    return OpenMediaSource(factory, params);
+    return OpenMediaSource(MakeReaderFactory(std::move(source)), params);
 }
 
-std::size_t CalcNumChunks(std::size_t numThreads)
+std::size_t CalcMemoryLimit(std::size_t numThreads, std::size_t chunkSize)
 {
     //We want to keep starting chunk containing metadata and at least one chunk
-    //for each thread, so for safety we keep twice as much 
-    return numThreads*2 + 1;
+    //for each thread, so for safety we keep twice as much. Read-ahead chunks
+    //of each thread must fit too
+    return Mul<std::size_t>(numThreads*(2 + cReadAheadChunks) + 1, chunkSize);
 }
 
-std::shared_ptr<SourceBase> OpenSource(const Options &options)
+OpenedSource OpenSource(const Options &options)
 {
-    return OpenSource(options.videoUrl,
-                      CalcNumChunks(options.numThreads),
-                      options.chunkSize);
+    //Single budget is shared by all cache tiers
+    auto limit = options.memoryLimit != 0
+                     ? options.memoryLimit
+                     : CalcMemoryLimit(options.numThreads, options.chunkSize);
+    return OpenSource(options, std::make_shared<MemoryBudget>(limit));
 }
 
 bool HasValidExtension(const std::filesystem::path &path)
@@ -1,6 +1,8 @@
 #include "LibavUtils.h"
 #include "Utils.h"
 
+#include <cstring>
+
 namespace vd::libav
 {
 
@@ -12,6 +14,14 @@ void CodecContextDeleter::operator()(const AVCodecContext *p) const
     }
 }
 
+void CodecParametersDeleter::operator()(const AVCodecParameters *p) const
+{
+    if(p != nullptr)
+    {
+        avcodec_parameters_free(const_cast<AVCodecParameters **>(&p));
+    }
+}
+
 void ParserContextDeleter::operator()(const AVCodecParserContext *p) const
 {
     if(p != nullptr)
@@ -95,7 +105,17 @@ int Reader::Read(std::span<std::byte> buf)
 
         auto available = Sub(GetContentLength(), mPos);
         auto subspan = buf.subspan(0, std::min(buf.size_bytes(), available));
-        mSrc->Read(mPos, subspan);
+
+        //Copying lent memory directly saves source from filling
+        //intermediate buffers
+        if(auto view = mSrc->View(mPos, subspan.size_bytes()); view)
+        {
+            std::memcpy(subspan.data(), view->data.data(), subspan.size_bytes());
+        }
+        else
+        {
+            mSrc->Read(mPos, subspan);
+        }
         mPos += subspan.size_bytes();
 
         return IntCast<int>(subspan.size_bytes());
@@ -234,6 +254,26 @@ UniquePtr<AVCodecContext> MakeCodecContext(const AVCodec *codec)
     return res;
 }
 
+UniquePtr<AVCodecParameters> MakeCodecParameters(const AVCodecParameters *par)
+{
+    auto res = UniquePtr<AVCodecParameters>{avcodec_parameters_alloc()};
+
+    if(!res)
+    {
+        throw Error{"failed to allocate codec parameters"};
+    }
+
+    if(par != nullptr)
+    {
+        if(auto err = avcodec_parameters_copy(res.get(), par); err < 0)
+        {
+            throw LibraryCallError{"avcodec_parameters_copy", err};
+        }
+    }
+
+    return res;
+}
+
 UniquePtr<AVCodecParserContext> MakeParserContext(AVCodecID codec_id)
 {
     auto res = UniquePtr<AVCodecParserContext>{av_parser_init(codec_id)};
@@ -58,6 +58,11 @@ struct CodecContextDeleter
     void operator()(const AVCodecContext *p) const;
 };
 
+struct CodecParametersDeleter
+{
+    void operator()(const AVCodecParameters *p) const;
+};
+
 struct ParserContextDeleter
 {
     void operator()(const AVCodecParserContext *p) const;
@@ -114,6 +119,18 @@ struct AvObjectTraits<const AVCodecContext>
     using Deleter = CodecContextDeleter;
 };
 
+template <>
+struct AvObjectTraits<AVCodecParameters>
+{
+    using Deleter = CodecParametersDeleter;
+};
+
+template <>
+struct AvObjectTraits<const AVCodecParameters>
+{
+    using Deleter = CodecParametersDeleter;
+};
+
 template <>
 struct AvObjectTraits<AVCodecParserContext>
 {
@@ -187,6 +204,9 @@ using BufferPtr = std::unique_ptr<std::uint8_t, GenericDeleter>;
 //naming is preserved
 UniquePtr<AVCodecContext> MakeCodecContext(const AVCodec *codec);
 
+//Parameters are copied from par if it isn't null
+UniquePtr<AVCodecParameters> MakeCodecParameters(const AVCodecParameters *par = nullptr);
+
 UniquePtr<AVCodecParserContext> MakeParserContext(AVCodecID codec_id);
 
 UniquePtr<AVPacket> MakePacket();
@@ -131,12 +131,51 @@ std::optional<Options> ParseOptions(int argc, const char * const * argv)
         "skip",
         "Allow skipping non-referenced frames to speedup processing",
         {'s', "skip"});
+    args::Flag stats(
+        parser,
+        "stats",
+        "Print amount of downloaded and consumed video data on exit",
+        {"stats"});
     args::ValueFlag<int> threads(
         parser,
         "threads",
-        "Number of simultaneously decoded segments (<number_of_cores + 1> by default, when set to 0 it's equal to number of segments)",
+        "Number of decoding threads (<number_of_cores + 1> by default, when set to 0 it's equal to number of segments)",
         {'t',"threads"},
         0);
+    args::ValueFlag<int> decoderThreads(
+        parser,
+        "decoder-threads",
+        "Number of threads of each decoder (cores left by decoding threads are split between decoders by default or when set to 0)",
+        {"decoder-threads"},
+        0);
+    args::ValueFlag<std::string> decoder(
+        parser,
+        "decoder",
+        "Name of decoder to use instead of default one of video codec (e.g. \"libdav1d\")",
+        {"decoder"});
+    args::ValueFlag<int> connections(
+        parser,
+        "connections",
+        "Maximum number of simultaneous HTTP connections (equal to number of threads by default or when set to 0)",
+        {'n',"connections"},
+        0);
+    args::ValueFlag<std::int64_t> memory(
+        parser,
+        "memory",
+        "Total size in MiB of memory used for caching video data (chosen by number of threads and chunk size by default or when set to 0)",
+        {'m',"memory"},
+        0);
+    args::ValueFlag<std::string> cacheDir(
+        parser,
+        "cache-dir",
+        "Directory to keep downloaded video chunks between runs (disabled by default)",
+        {"cache-dir"});
+    args::ValueFlag<std::int64_t> cacheSize(
+        parser,
+        "cache-size",
+        "Maximum size in MiB of chunks kept in cache directory (1024 by default)",
+        {"cache-size"},
+        1024);
     args::Positional<std::string> source(parser, "source", "Video source (url/file)", args::Options::Required);
     args::PositionalList<std::string> segments(
         parser,
@@ -148,23 +187,47 @@ std::optional<Options> ParseOptions(int argc, const char * const * argv)
     {
         parser.ParseCLI(argc, argv);
 
-        std::uint8_t numThreads;
+        std::size_t numThreads;
         try
         {
             if(!threads.Matched())
             {
-                numThreads = IntCast<std::uint8_t>(GetNumCores()  + 1);
+                numThreads = GetNumCores() + std::size_t{1};
             } else {
-                numThreads = IntCast<std::uint8_t>(threads.Get());
+                numThreads = IntCast<std::size_t>(threads.Get());
                 if(numThreads == 0)
                 {
-                    numThreads = IntCast<std::uint8_t>(std::distance(segments.begin(), segments.end()));
+                    numThreads = IntCast<std::size_t>(std::distance(segments.begin(), segments.end()));
                 }
             }
         }
         catch(...)
         {
-            throw Error{R"("threads" parameter must be integer in range [0:255])"};
+            throw Error{R"("threads" parameter must be non-negative integer)"};
+        }
+
+        std::size_t numDecoderThreads;
+        try
+        {
+            numDecoderThreads = IntCast<std::size_t>(decoderThreads.Get());
+        }
+        catch(...)
+        {
+            throw Error{R"("decoder-threads" parameter must be non-negative integer)"};
+        }
+
+        std::size_t numConnections;
+        try
+        {
+            numConnections = IntCast<std::size_t>(connections.Get());
+            if(numConnections == 0)
+            {
+                numConnections = numThreads;
+            }
+        }
+        catch(...)
+        {
+            throw Error{R"("connections" parameter must be non-negative integer)"};
         }
 
         std::size_t chunkSize;
@@ -181,12 +244,39 @@ std::optional<Options> ParseOptions(int argc, const char * const * argv)
             throw Error{R"("chunk" parameter must be positive and in range of 64-bit signed integer values)"};
         }
 
+        std::size_t memoryLimit;
+        try
+        {
+            memoryLimit = Mul<std::size_t>(IntCast<std::size_t>(memory.Get()), std::size_t{1} << 20);
+        }
+        catch(...)
+        {
+            throw Error{R"("memory" parameter must be non-negative integer)"};
+        }
+
+        std::size_t cacheSizeBytes;
+        try
+        {
+            cacheSizeBytes = Mul<std::size_t>(IntCast<std::size_t>(cacheSize.Get()), std::size_t{1} << 20);
+        }
+        catch(...)
+        {
+            throw Error{R"("cache-size" parameter must be non-negative integer)"};
+        }
+
         return Options{ .format = ConvertFormat(format.Get()),
                         .videoUrl = source.Get(),
                         .segments = ParseSegments(segments),
                         .numThreads = numThreads,
+                        .decoderThreads = numDecoderThreads,
+                        .decoder = decoder.Get(),
+                        .numConnections = numConnections,
                         .chunkSize = chunkSize,
-                        .skipping = skipping };
+                        .memoryLimit = memoryLimit,
+                        .cacheDir = cacheDir.Get(),
+                        .cacheSize = cacheSizeBytes,
+                        .skipping = skipping,
+                        .printStats = stats };
     }
     catch(args::Help &)
     {
@@ -3,6 +3,7 @@
 
 #include <chrono>
 #include <cstdint>
+#include <filesystem>
 #include <optional>
 #include <string>
 
@@ -21,9 +22,21 @@ struct Options final
     std::string format;
     std::string videoUrl;
     std::vector<Segment> segments;
-    std::uint8_t numThreads;
+    std::size_t numThreads;
+    //Threads of each decoder, 0 means they're chosen by number of workers
+    std::size_t decoderThreads;
+    //Default decoder of codec is used if empty
+    std::string decoder;
+    std::size_t numConnections;
     std::size_t chunkSize;
+    //Total size in bytes of memory used by caches, 0 means it's chosen
+    //automatically
+    std::size_t memoryLimit;
+    //Disk cache is disabled if directory is empty
+    std::filesystem::path cacheDir;
+    std::size_t cacheSize;
     bool skipping;
+    bool printStats;
 };
 
 
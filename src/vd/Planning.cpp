@@ -0,0 +1,115 @@
+#include "Planning.h"
+#include "Errors.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+namespace vd
+{
+
+using namespace std::chrono_literals;
+
+std::vector<FrameTarget> MakeSegmentTargets(const Options::Segment &segment, std::size_t segIdx)
+{
+    auto interval = (segment.to - segment.from) / (segment.numFrames + 1ll);
+    //== 0 is very extreme case but still possible
+    if(interval <= 0ns)
+    {
+        throw Error{Format("too many frames ({}) requested in segment",
+                           segment.numFrames)};
+    }
+
+    auto numFrames = segment.numFrames + std::size_t{2};
+    auto res = std::vector<FrameTarget>{};
+    res.reserve(numFrames);
+    for(std::size_t frameIdx = 0; frameIdx < numFrames; ++frameIdx)
+    {
+        res.push_back(FrameTarget{.timestamp = segment.from + interval*IntCast<std::int64_t>(frameIdx),
+                                  .segIdx = segIdx,
+                                  .frameIdx = frameIdx});
+    }
+
+    return res;
+}
+
+namespace
+{
+
+//Every part seeks to its first target, so decoding is wasted only on the
+//GOP where segment is split
+std::vector<DecodeTask> SplitSegments(std::vector<std::vector<FrameTarget>> segTargets,
+                                      std::size_t minTasks)
+{
+    auto numTargets = std::size_t{0};
+    for(const auto &targets : segTargets)
+    {
+        numTargets += targets.size();
+    }
+
+    auto tasks = std::vector<DecodeTask>{};
+    for(auto &targets : segTargets)
+    {
+        auto share = (targets.size()*minTasks + numTargets - 1) / numTargets;
+        auto numParts = std::clamp<std::size_t>(share, 1, targets.size());
+        for(std::size_t part = 0; part < numParts; ++part)
+        {
+            auto first = targets.begin() + IntCast<std::ptrdiff_t>(part*targets.size()/numParts);
+            auto last = targets.begin() + IntCast<std::ptrdiff_t>((part + 1)*targets.size()/numParts);
+            tasks.push_back(DecodeTask{.keyframe = 0ns,
+                                       .targets = std::vector(std::make_move_iterator(first),
+                                                              std::make_move_iterator(last))});
+        }
+    }
+
+    return tasks;
+}
+
+}//unnamed namespace
+
+std::vector<DecodeTask> PlanDecoding(std::span<const Options::Segment> segments,
+                                     std::span<const Nanoseconds> keyframes,
+                                     std::size_t minTasks)
+{
+    auto segTargets = std::vector<std::vector<FrameTarget>>{};
+    segTargets.reserve(segments.size());
+    for(std::size_t segIdx = 0; segIdx < segments.size(); ++segIdx)
+    {
+        segTargets.push_back(MakeSegmentTargets(segments[segIdx], segIdx));
+    }
+
+    if(keyframes.empty())
+    {
+        return SplitSegments(std::move(segTargets), minTasks);
+    }
+
+    auto targets = std::vector<FrameTarget>{};
+    for(const auto &seg : segTargets)
+    {
+        std::ranges::copy(seg, std::back_inserter(targets));
+    }
+    std::ranges::stable_sort(targets, {}, &FrameTarget::timestamp);
+
+    auto tasks = std::vector<DecodeTask>{};
+
+    for(const auto &target : targets)
+    {
+        //Targets preceding first keyframe are decoded from the start
+        auto it = std::ranges::upper_bound(keyframes, target.timestamp);
+        auto keyframe = it != keyframes.begin() ? *std::prev(it) : 0ns;
+
+        if(tasks.empty() || tasks.back().keyframe != keyframe)
+        {
+            tasks.push_back(DecodeTask{.keyframe = keyframe, .targets = {}});
+        }
+        tasks.back().targets.push_back(target);
+    }
+
+    return tasks;
+}
+
+std::size_t CalcDecoderThreads(std::size_t numWorkers, std::size_t numCores) noexcept
+{
+    return std::max<std::size_t>(numCores / std::max<std::size_t>(numWorkers, 1), 1);
+}
+
+} //namespace vd
@@ -0,0 +1,48 @@
+#ifndef VDOWNLOADER_VD_PLANNING_H_
+#define VDOWNLOADER_VD_PLANNING_H_
+
+#include "Options.h"
+#include "VideoUtils.h"
+
+#include <span>
+#include <vector>
+
+namespace vd
+{
+
+//Frame requested by segment, indices are 0-based
+struct FrameTarget final
+{
+    Nanoseconds timestamp;
+    std::size_t segIdx;
+    std::size_t frameIdx;
+};
+
+//Targets are ordered by timestamp, so single stream decodes them without
+//seeking backward
+struct DecodeTask final
+{
+    //Start of GOP containing targets, zero if GOPs are unknown
+    Nanoseconds keyframe;
+    std::vector<FrameTarget> targets;
+};
+
+
+
+//Frames of segment are evenly spaced between its boundaries, which are
+//requested too
+std::vector<FrameTarget> MakeSegmentTargets(const Options::Segment &segment, std::size_t segIdx);
+//Targets of all segments are grouped by GOPs, so overlapping segments don't
+//decode the same GOP twice. Keyframes must be sorted. If they are unknown,
+//segments are split into contiguous parts proportionally to their number of
+//targets, so there are at least minTasks tasks when there are enough targets
+std::vector<DecodeTask> PlanDecoding(std::span<const Options::Segment> segments,
+                                     std::span<const Nanoseconds> keyframes,
+                                     std::size_t minTasks = 1);
+//Cores which aren't occupied by workers are split evenly between their
+//decoders, so few segments still load the whole machine
+std::size_t CalcDecoderThreads(std::size_t numWorkers, std::size_t numCores) noexcept;
+
+} //namespace vd
+
+#endif //VDOWNLOADER_VD_PLANNING_H_
@@ -3,15 +3,392 @@
 
 #include <ada.h>
 
+#include <algorithm>
+#include <bit>
+#include <cctype>
 #include <cstring>
 #include <functional>
+#include <iterator>
 #include <limits>
+#include <regex>
+
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    #include <Windows.h>
+#else
+    #include <cerrno>
+    #include <cstdlib>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 using namespace httplib;
 
 namespace vd
 {
 
+MemoryBudget::Reservation::Reservation(std::shared_ptr<MemoryBudget> budget,
+                                       std::size_t size) noexcept
+    : mBudget{std::move(budget)},
+      mSize{size}
+{
+
+}
+
+MemoryBudget::Reservation::Reservation(Reservation &&other) noexcept
+    : mBudget{std::move(other.mBudget)},
+      mSize{std::exchange(other.mSize, 0)}
+{
+
+}
+
+MemoryBudget::Reservation &MemoryBudget::Reservation::operator=(Reservation &&other) noexcept
+{
+    if(this != &other)
+    {
+        Release();
+        mBudget = std::move(other.mBudget);
+        mSize = std::exchange(other.mSize, 0);
+    }
+
+    return *this;
+}
+
+MemoryBudget::Reservation::~Reservation()
+{
+    Release();
+}
+
+std::size_t MemoryBudget::Reservation::Size() const noexcept
+{
+    return mSize;
+}
+
+void MemoryBudget::Reservation::Release() noexcept
+{
+    if(mBudget)
+    {
+        mBudget->mUsed.fetch_sub(mSize, std::memory_order_relaxed);
+        mBudget.reset();
+    }
+
+    mSize = 0;
+}
+
+MemoryBudget::MemoryBudget(std::size_t limit)
+    : mLimit{limit}
+{
+
+}
+
+std::size_t MemoryBudget::Limit() const noexcept
+{
+    return mLimit;
+}
+
+std::size_t MemoryBudget::Used() const noexcept
+{
+    return mUsed.load(std::memory_order_relaxed);
+}
+
+std::optional<MemoryBudget::Reservation> MemoryBudget::TryReserve(std::size_t size)
+{
+    auto self = shared_from_this();
+    auto used = mUsed.load(std::memory_order_relaxed);
+    do
+    {
+        if(used > mLimit || size > mLimit - used)
+        {
+            return std::nullopt;
+        }
+    }
+    while(!mUsed.compare_exchange_weak(used, used + size, std::memory_order_relaxed));
+
+    return Reservation{std::move(self), size};
+}
+
+MemoryBudget::Reservation MemoryBudget::ReserveUpTo(std::size_t size)
+{
+    auto self = shared_from_this();
+    auto used = mUsed.load(std::memory_order_relaxed);
+    auto reserved = std::size_t{0};
+    do
+    {
+        reserved = used < mLimit ? std::min(size, mLimit - used) : 0;
+    }
+    while(!mUsed.compare_exchange_weak(used, used + reserved, std::memory_order_relaxed));
+
+    return Reservation{std::move(self), reserved};
+}
+
+MemoryBudget::Reservation MemoryBudget::Reserve(std::size_t size)
+{
+    auto self = shared_from_this();
+    //Overflow is impossible, because memory of such size can't be allocated
+    mUsed.fetch_add(size, std::memory_order_relaxed);
+    return Reservation{std::move(self), size};
+}
+
+ChunkArena::Block::Block(std::shared_ptr<ChunkArena> arena, std::byte *data) noexcept
+    : mArena{std::move(arena)},
+      mData{data}
+{
+
+}
+
+ChunkArena::Block::Block(Block &&other) noexcept
+    : mArena{std::move(other.mArena)},
+      mData{std::exchange(other.mData, nullptr)}
+{
+
+}
+
+ChunkArena::Block &ChunkArena::Block::operator=(Block &&other) noexcept
+{
+    if(this != &other)
+    {
+        Release();
+        mArena = std::move(other.mArena);
+        mData = std::exchange(other.mData, nullptr);
+    }
+
+    return *this;
+}
+
+ChunkArena::Block::~Block()
+{
+    Release();
+}
+
+std::span<std::byte> ChunkArena::Block::Data() const noexcept
+{
+    return mArena ? std::span<std::byte>{mData, mArena->mBlockSize} : std::span<std::byte>{};
+}
+
+void ChunkArena::Block::Release() noexcept
+{
+    if(mArena)
+    {
+        mArena->Release(mData);
+        mArena.reset();
+    }
+
+    mData = nullptr;
+}
+
+ChunkArena::ChunkArena(std::size_t blockSize,
+                       std::size_t maxFree,
+                       bool useHugePages,
+                       std::shared_ptr<MemoryBudget> budget)
+    : mBlockSize{blockSize},
+      mMaxFree{maxFree},
+#if defined(VDOWNLOADER_OS_WINDOWS) || !defined(MADV_HUGEPAGE)
+      mUseHugePages{(static_cast<void>(useHugePages), false)},
+#else
+      mUseHugePages{useHugePages && blockSize >= cHugePageSize},
+#endif
+      mMemorySize{mUseHugePages ? Add<std::size_t>(blockSize, cHugePageSize - 1) & ~(cHugePageSize - 1)
+                                : blockSize},
+      mBudget{std::move(budget)}
+{
+    if(mBlockSize < 1)
+    {
+        throw ArgumentError{"block size must be greater than 0"};
+    }
+
+    //Release mustn't allocate
+    mFree.reserve(mMaxFree);
+}
+
+ChunkArena::~ChunkArena()
+{
+    for(auto *data : mFree)
+    {
+        FreeMemory(data);
+    }
+}
+
+std::size_t ChunkArena::BlockSize() const noexcept
+{
+    return mBlockSize;
+}
+
+std::size_t ChunkArena::MemorySize() const noexcept
+{
+    return mMemorySize;
+}
+
+std::size_t ChunkArena::NumFree() const
+{
+    std::lock_guard lock{mMtx};
+    return mFree.size();
+}
+
+ChunkArena::Block ChunkArena::Allocate()
+{
+    auto self = shared_from_this();
+
+    {
+        std::lock_guard lock{mMtx};
+        if(!mFree.empty())
+        {
+            auto *data = mFree.back();
+            mFree.pop_back();
+            return Block{std::move(self), data};
+        }
+    }
+
+    return Block{std::move(self), AllocateMemory()};
+}
+
+std::byte *ChunkArena::AllocateMemory()
+{
+#if !defined(VDOWNLOADER_OS_WINDOWS) && defined(MADV_HUGEPAGE)
+    if(mUseHugePages)
+    {
+        //Kernel aligns mapping to ordinary page only, so it's aligned to
+        //huge page manually by trimming excess
+        auto size = mMemorySize;
+        auto mappedSize = Add<std::size_t>(size, cHugePageSize);
+        auto *ptr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptr == MAP_FAILED)
+        {
+            throw LibraryCallError{"mmap", errno};
+        }
+
+        auto *begin = static_cast<std::byte *>(ptr);
+        auto head = (cHugePageSize - reinterpret_cast<std::uintptr_t>(begin) % cHugePageSize) % cHugePageSize;
+        if(head > 0)
+        {
+            munmap(begin, head);
+        }
+        munmap(begin + head + size, mappedSize - head - size);
+
+        //Failure only means that ordinary pages are used
+        madvise(begin + head, size, MADV_HUGEPAGE);
+        return begin + head;
+    }
+#endif
+
+    //Memory is left uninitialized, because it's overwritten by source anyway
+    return new std::byte[mBlockSize];
+}
+
+void ChunkArena::FreeMemory(std::byte *data) noexcept
+{
+#if !defined(VDOWNLOADER_OS_WINDOWS) && defined(MADV_HUGEPAGE)
+    if(mUseHugePages)
+    {
+        munmap(data, mMemorySize);
+        return;
+    }
+#endif
+
+    delete[] data;
+}
+
+void ChunkArena::Trim() noexcept
+{
+    std::lock_guard lock{mMtx};
+    auto maxFree = GetMaxFree();
+    while(mFree.size() > maxFree)
+    {
+        FreeMemory(mFree.back());
+        mFree.pop_back();
+    }
+}
+
+std::size_t ChunkArena::GetMaxFree() const noexcept
+{
+    if(!mBudget)
+    {
+        return mMaxFree;
+    }
+
+    auto limit = mBudget->Limit();
+    auto used = mBudget->Used();
+    return used < limit ? std::min(mMaxFree, (limit - used) / mMemorySize) : 0;
+}
+
+void ChunkArena::Release(std::byte *data) noexcept
+{
+    {
+        std::lock_guard lock{mMtx};
+        if(mFree.size() < GetMaxFree())
+        {
+            mFree.push_back(data);
+            return;
+        }
+    }
+
+    FreeMemory(data);
+}
+
+
+
+namespace
+{
+
+template <std::unsigned_integral T>
+T ReadBigEndian(std::span<const std::byte> data, std::size_t pos) noexcept
+{
+    T val;
+    std::memcpy(&val, std::next(data.data(), pos), sizeof val);
+    return EndianCastFrom<std::endian::big>(val);
+}
+
+}//unnamed namespace
+
+std::optional<std::size_t> FindTrailingMp4Metadata(std::span<const std::byte> head,
+                                                   std::size_t contentLength)
+{
+    constexpr std::size_t headerSize = 8;
+    constexpr std::size_t largeHeaderSize = 16;
+
+    auto pos = std::size_t{0};
+    auto isMediaDataSeen = false;
+    while(head.size() >= headerSize && pos <= head.size() - headerSize)
+    {
+        auto size = std::uint64_t{ReadBigEndian<std::uint32_t>(head, pos)};
+        auto type = std::string_view{reinterpret_cast<const char *>(std::next(head.data(), pos + 4)), 4};
+        auto boxHeaderSize = headerSize;
+
+        //Size 1 means that 64-bit size follows type, 0 means that box lasts
+        //till the end
+        if(size == 1)
+        {
+            if(head.size() < largeHeaderSize || pos > head.size() - largeHeaderSize)
+            {
+                return std::nullopt;
+            }
+
+            size = ReadBigEndian<std::uint64_t>(head, pos + headerSize);
+            boxHeaderSize = largeHeaderSize;
+        }
+
+        if((pos == 0 && type != "ftyp") ||
+           type == "moov" ||
+           size < boxHeaderSize ||
+           size > contentLength - pos)
+        {
+            return std::nullopt;
+        }
+
+        isMediaDataSeen = isMediaDataSeen || type == "mdat";
+        pos += static_cast<std::size_t>(size);
+    }
+
+    if(!isMediaDataSeen || pos >= contentLength)
+    {
+        return std::nullopt;
+    }
+
+    return pos;
+}
+
+
+
 namespace internal
 {
 
@@ -25,6 +402,23 @@ void AssertRangeCorrect(
     }
 }
 
+std::size_t CalcMaxReadAhead(std::size_t maxChunks,
+                             std::size_t chunkSize,
+                             const MemoryBudget *budget) noexcept
+{
+    if(maxChunks != 0)
+    {
+        return maxChunks / 2;
+    }
+
+    if(budget && chunkSize != 0)
+    {
+        return budget->Limit() / chunkSize / 2;
+    }
+
+    return std::numeric_limits<std::size_t>::max();
+}
+
 std::string_view ExtractAddress(std::string_view url)
 {
     auto parsed = ada::parse(url);
@@ -45,46 +439,1716 @@ std::string_view ExtractAddress(std::string_view url)
     return url.substr(0, parsed->get_components().pathname_start);
 }
 
-std::string_view ExtractPathAndQuery(std::string_view url)
+std::string_view ExtractPathAndQuery(std::string_view url)
+{
+    auto parsed = ada::parse(url);
+    if(!parsed.has_value())
+    {
+        throw ArgumentError{std::format(R"("{}" is not a valid url)", url)};
+    }
+
+    auto components = parsed->get_components();
+    if(components.pathname_start >= url.size())
+    {
+        return "/";
+    }
+
+    return url.substr(components.pathname_start);
+}
+
+
+
+std::vector<RequestGroup> GroupAdjacent(std::span<const ReadRequest> requests)
+{
+    auto sorted = std::vector<ReadRequest>{};
+    sorted.reserve(requests.size());
+    std::ranges::copy_if(requests,
+                         std::back_inserter(sorted),
+                         [](const ReadRequest &request) { return !request.buf.empty(); });
+    std::ranges::sort(sorted, std::ranges::less{}, &ReadRequest::pos);
+
+    auto groups = std::vector<RequestGroup>{};
+    for(const auto &request : sorted)
+    {
+        auto end = Add<std::size_t>(request.pos, request.buf.size_bytes());
+        if(!groups.empty() && request.pos <= groups.back().pos + groups.back().size)
+        {
+            auto &group = groups.back();
+            group.size = std::max(group.pos + group.size, end) - group.pos;
+            group.requests.push_back(request);
+        }
+        else
+        {
+            groups.push_back(RequestGroup{.pos = request.pos,
+                                          .size = request.buf.size_bytes(),
+                                          .requests = {request}});
+        }
+    }
+
+    return groups;
+}
+
+void CopyOverlap(std::size_t pos,
+                 std::span<const std::byte> data,
+                 std::span<const ReadRequest> requests) noexcept
+{
+    auto end = pos + data.size_bytes();
+    for(const auto &request : requests)
+    {
+        auto from = std::max(pos, request.pos);
+        auto to = std::min(end, request.pos + request.buf.size_bytes());
+        if(from < to)
+        {
+            std::memcpy(std::next(request.buf.data(), from - request.pos),
+                        std::next(data.data(), from - pos),
+                        to - from);
+        }
+    }
+}
+
+FetchScheduler::Permit::Permit(FetchScheduler &scheduler, FetchPriority priority) noexcept
+    : mScheduler{&scheduler},
+      mPriority{priority}
+{
+}
+
+FetchScheduler::Permit::Permit(Permit &&other) noexcept
+    : mScheduler{std::exchange(other.mScheduler, nullptr)},
+      mPriority{other.mPriority}
+{
+}
+
+FetchScheduler::Permit &FetchScheduler::Permit::operator=(Permit &&other) noexcept
+{
+    if(this != &other)
+    {
+        Release();
+        mScheduler = std::exchange(other.mScheduler, nullptr);
+        mPriority = other.mPriority;
+    }
+
+    return *this;
+}
+
+FetchScheduler::Permit::~Permit()
+{
+    Release();
+}
+
+FetchScheduler::Permit::operator bool() const noexcept
+{
+    return mScheduler != nullptr;
+}
+
+void FetchScheduler::Permit::Release() noexcept
+{
+    if(!mScheduler)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock{mScheduler->mMtx};
+        --mScheduler->mNumActive[static_cast<std::size_t>(mPriority)];
+    }
+
+    //Waiters of different priorities wait for different conditions
+    mScheduler->mCv.notify_all();
+    mScheduler = nullptr;
+}
+
+FetchScheduler::FetchScheduler(std::size_t maxActive)
+    : mMaxActive{maxActive}
+{
+}
+
+FetchScheduler::Permit FetchScheduler::Acquire(FetchPriority priority)
+{
+    auto idx = static_cast<std::size_t>(priority);
+
+    std::unique_lock lock{mMtx};
+    ++mNumWaiting[idx];
+    mCv.wait(lock,
+             [this, priority]()
+             {
+                 return CanStart(priority);
+             });
+    --mNumWaiting[idx];
+    ++mNumActive[idx];
+    lock.unlock();
+
+    //Fetches of lower priority may have been blocked by this waiter
+    mCv.notify_all();
+    return Permit{*this, priority};
+}
+
+std::optional<FetchScheduler::Permit> FetchScheduler::TryAcquire(FetchPriority priority)
+{
+    std::lock_guard lock{mMtx};
+    if(!CanStart(priority))
+    {
+        return std::nullopt;
+    }
+
+    ++mNumActive[static_cast<std::size_t>(priority)];
+    return Permit{*this, priority};
+}
+
+std::size_t FetchScheduler::NumWaiting(FetchPriority priority) const
+{
+    std::lock_guard lock{mMtx};
+    return mNumWaiting[static_cast<std::size_t>(priority)];
+}
+
+bool FetchScheduler::CanStart(FetchPriority priority) const noexcept
+{
+    auto idx = static_cast<std::size_t>(priority);
+    auto numActive = std::size_t{0};
+    for(auto n : mNumActive)
+    {
+        numActive += n;
+    }
+
+    if(mMaxActive != 0 && numActive >= mMaxActive)
+    {
+        return false;
+    }
+
+    auto numUrgent = std::size_t{0};
+    for(std::size_t i = 0; i < idx; ++i)
+    {
+        if(mNumWaiting[i] != 0)
+        {
+            return false;
+        }
+
+        numUrgent += mNumActive[i];
+    }
+
+    //Slot is left for demand fetch which may come while speculative one runs
+    if(priority == FetchPriority::Speculative && numUrgent != 0)
+    {
+        return mMaxActive == 0 || numActive + 1 < mMaxActive;
+    }
+
+    return true;
+}
+
+namespace
+{
+
+bool EqualsIgnoreCase(std::string_view l, std::string_view r)
+{
+    return std::ranges::equal(
+        l,
+        r,
+        [](char lc, char rc)
+        {
+            return std::tolower(static_cast<unsigned char>(lc)) ==
+                   std::tolower(static_cast<unsigned char>(rc));
+        });
+}
+
+std::string_view Trim(std::string_view str)
+{
+    auto from = str.find_first_not_of(" \t");
+    if(from == std::string_view::npos)
+    {
+        return {};
+    }
+
+    return str.substr(from, str.find_last_not_of(" \t") - from + 1);
+}
+
+}//unnamed namespace
+
+std::optional<std::string> ExtractByteRangesBoundary(std::string_view contentType)
+{
+    auto semicolon = contentType.find(';');
+    if(!EqualsIgnoreCase(Trim(contentType.substr(0, semicolon)), "multipart/byteranges"))
+    {
+        return std::nullopt;
+    }
+
+    while(semicolon != std::string_view::npos)
+    {
+        contentType = contentType.substr(semicolon + 1);
+        semicolon = contentType.find(';');
+        auto param = contentType.substr(0, semicolon);
+
+        auto eq = param.find('=');
+        if(eq == std::string_view::npos || !EqualsIgnoreCase(Trim(param.substr(0, eq)), "boundary"))
+        {
+            continue;
+        }
+
+        auto value = Trim(param.substr(eq + 1));
+        if(value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        {
+            value = value.substr(1, value.size() - 2);
+        }
+
+        if(!value.empty())
+        {
+            return std::string{value};
+        }
+    }
+
+    throw Error{"multipart/byteranges content type doesn't contain boundary"};
+}
+
+std::pair<std::size_t, std::size_t> ParseContentRange(std::string_view value)
+{
+    static const auto re = std::regex(R"(^\s*bytes\s+(\d+)-(\d+)/(?:\d+|\*)\s*$)", std::regex::icase);
+
+    auto str = std::string{value};
+    auto matches = std::smatch{};
+    if(!std::regex_match(str, matches, re))
+    {
+        throw Error{std::format(R"(content range "{}" has unknown format)", value)};
+    }
+
+    auto first = StrToUint<std::size_t>(matches[1].str());
+    auto last = StrToUint<std::size_t>(matches[2].str());
+    if(first > last)
+    {
+        throw RangeError{std::format(R"(content range "{}" is empty)", value)};
+    }
+
+    return {first, last};
+}
+
+std::optional<std::size_t> ParseContentRangeLength(std::string_view value)
+{
+    static const auto re = std::regex(R"(^\s*bytes\s+\d+-\d+/(\d+|\*)\s*$)", std::regex::icase);
+
+    auto str = std::string{value};
+    auto matches = std::smatch{};
+    if(!std::regex_match(str, matches, re))
+    {
+        throw Error{std::format(R"(content range "{}" has unknown format)", value)};
+    }
+
+    if(matches[1] == "*")
+    {
+        return std::nullopt;
+    }
+
+    return StrToUint<std::size_t>(matches[1].str());
+}
+
+ByteRangesParser::ByteRangesParser(std::string_view boundary, Sink sink)
+    : mDelimiter{"--" + std::string{boundary}},
+      mSink{std::move(sink)}
+{
+
+}
+
+void ByteRangesParser::Feed(std::string_view data)
+{
+    //Data following headers in text is moved here to be passed to sink
+    auto rest = std::string{};
+    while(!data.empty() && mState != State::Complete)
+    {
+        if(mState == State::Data)
+        {
+            auto len = std::min(mRemaining, data.size());
+            mSink(mPos, std::as_bytes(std::span{data.data(), len}));
+            mPos += len;
+            mRemaining -= len;
+            data.remove_prefix(len);
+            if(mRemaining == 0)
+            {
+                mState = State::Delimiter;
+            }
+            continue;
+        }
+
+        mText.append(data);
+        data = {};
+        ParseText();
+        if(mState == State::Data)
+        {
+            rest = std::move(mText);
+            mText.clear();
+            data = rest;
+        }
+    }
+}
+
+void ByteRangesParser::Finish() const
+{
+    if(mState != State::Complete)
+    {
+        throw Error{"multipart/byteranges body is truncated"};
+    }
+}
+
+void ByteRangesParser::ParseText()
+{
+    auto isParsed = true;
+    while(isParsed)
+    {
+        isParsed = (mState == State::Delimiter && ParseDelimiter()) ||
+                   (mState == State::Headers && ParseHeaders());
+    }
+}
+
+bool ByteRangesParser::ParseDelimiter()
+{
+    auto pos = mText.find(mDelimiter);
+    if(pos == std::string::npos)
+    {
+        //Only text which may be beginning of delimiter is kept
+        mText.erase(0, mText.size() - std::min(mText.size(), mDelimiter.size() - 1));
+        return false;
+    }
+
+    //Closing delimiter is followed by "--"
+    mText.erase(0, pos + mDelimiter.size());
+    if(mText.size() < 2)
+    {
+        mText.insert(0, mDelimiter);
+        return false;
+    }
+
+    mState = mText.starts_with("--") ? State::Complete : State::Headers;
+    return true;
+}
+
+bool ByteRangesParser::ParseHeaders()
+{
+    //Rest of delimiter line is padding
+    auto headersStart = mText.find("\r\n");
+    auto headersEnd = headersStart == std::string::npos ? std::string::npos : mText.find("\r\n\r\n", headersStart);
+    if(headersEnd == std::string::npos)
+    {
+        if(mText.size() > cMaxHeadersSize)
+        {
+            throw Error{"multipart/byteranges body is malformed"};
+        }
+        return false;
+    }
+
+    auto range = std::optional<std::pair<std::size_t, std::size_t>>{};
+    auto headers = std::string_view{mText}.substr(headersStart + 2, headersEnd - headersStart);
+    while(!headers.empty())
+    {
+        auto lineEnd = headers.find("\r\n");
+        auto line = headers.substr(0, lineEnd);
+        headers = lineEnd == std::string_view::npos ? std::string_view{} : headers.substr(lineEnd + 2);
+
+        auto colon = line.find(':');
+        if(colon != std::string_view::npos && EqualsIgnoreCase(Trim(line.substr(0, colon)), "Content-Range"))
+        {
+            range = ParseContentRange(line.substr(colon + 1));
+        }
+    }
+
+    if(!range)
+    {
+        throw Error{"part of multipart/byteranges body doesn't contain Content-Range"};
+    }
+
+    mPos = range->first;
+    mRemaining = range->second - range->first + 1;
+    mState = State::Data;
+    mText.erase(0, headersEnd + 4);
+    return true;
+}
+
+ClientPool::Lease::Lease(ClientPool &pool, std::unique_ptr<httplib::Client> client)
+    : mPool{pool},
+      mClient{std::move(client)}
+{
+
+}
+
+ClientPool::Lease::~Lease()
+{
+    if(mClient)
+    {
+        mPool.get().Release(std::move(mClient));
+    }
+}
+
+httplib::Client *ClientPool::Lease::operator->() const noexcept
+{
+    return mClient.get();
+}
+
+httplib::Client &ClientPool::Lease::operator*() const noexcept
+{
+    return *mClient;
+}
+
+ClientPool::ClientPool(std::string address,
+                       std::size_t maxClients,
+                       std::unique_ptr<httplib::Client> initial)
+    : mAddress{std::move(address)},
+      mMaxClients{maxClients}
+{
+    if(mMaxClients == 0)
+    {
+        throw ArgumentError{"maximum number of clients must be greater than 0"};
+    }
+
+    mIdle.reserve(mMaxClients);
+    if(initial)
+    {
+        mIdle.push_back(std::move(initial));
+        mNumClients = 1;
+    }
+}
+
+const std::string &ClientPool::Address() const noexcept
+{
+    return mAddress;
+}
+
+std::size_t ClientPool::MaxClients() const noexcept
+{
+    return mMaxClients;
+}
+
+bool ClientPool::IsExhausted() const
+{
+    std::lock_guard lock{mMtx};
+    return mIdle.empty() && !(mNumClients < mMaxClients);
+}
+
+ClientPool::Lease ClientPool::Acquire(std::stop_token stop)
+{
+    auto lock = std::unique_lock{mMtx};
+    auto isAvailable =
+        mCv.wait(lock, stop, [this]() { return !mIdle.empty() || mNumClients < mMaxClients; });
+    if(!isAvailable)
+    {
+        throw HttplibError{httplib::Error::Canceled};
+    }
+
+    if(!mIdle.empty())
+    {
+        auto client = std::move(mIdle.back());
+        mIdle.pop_back();
+        return Lease{*this, std::move(client)};
+    }
+
+    //Connection itself is established on first request, so it's cheap to
+    //create client under lock
+    auto client = MakeClient(mAddress);
+    mNumClients += 1;
+    return Lease{*this, std::move(client)};
+}
+
+std::unique_ptr<Client> ClientPool::MakeClient(const std::string &address)
+{
+    auto client = std::make_unique<Client>(address);
+    client->set_keep_alive(true);
+    client->set_follow_location(true);
+    return client;
+}
+
+void ClientPool::Release(std::unique_ptr<httplib::Client> client) noexcept
+{
+    {
+        std::lock_guard lock{mMtx};
+        //Can't throw because capacity for all clients is reserved in constructor
+        mIdle.push_back(std::move(client));
+    }
+
+    mCv.notify_one();
+}
+
+
+
+LatencyTracker::LatencyTracker(std::size_t capacity)
+{
+    if(capacity < cMinSamples)
+    {
+        throw ArgumentError{std::format("capacity must be at least {}", cMinSamples)};
+    }
+
+    mSamples.reserve(capacity);
+}
+
+void LatencyTracker::Add(Duration latency)
+{
+    std::lock_guard lock{mMtx};
+    if(mSamples.size() < mSamples.capacity())
+    {
+        mSamples.push_back(latency);
+        return;
+    }
+
+    mSamples[mNext] = latency;
+    mNext = (mNext + 1) % mSamples.size();
+}
+
+std::optional<LatencyTracker::Duration> LatencyTracker::Percentile(double fraction) const
+{
+    if(!(fraction >= 0.0 && fraction <= 1.0))
+    {
+        throw ArgumentError{"percentile fraction must be in [0, 1]"};
+    }
+
+    auto samples = std::vector<Duration>{};
+    {
+        std::lock_guard lock{mMtx};
+        if(mSamples.size() < cMinSamples)
+        {
+            return std::nullopt;
+        }
+
+        samples = mSamples;
+    }
+
+    auto idx = static_cast<std::size_t>(fraction * static_cast<double>(samples.size() - 1));
+    auto nth = std::next(samples.begin(), static_cast<std::ptrdiff_t>(idx));
+    std::ranges::nth_element(samples, nth);
+    return *nth;
+}
+
+
+
+Hedger::Hedger(std::shared_ptr<ClientPool> pool, std::size_t maxHedges)
+    : mPool{std::move(pool)},
+      mMaxHedges{maxHedges}
+{
+    if(mMaxHedges == 0)
+    {
+        throw ArgumentError{"maximum number of hedges must be greater than 0"};
+    }
+
+    mQueued.reserve(mMaxHedges);
+    mRunning.reserve(mMaxHedges);
+    mWorkers.reserve(mMaxHedges);
+}
+
+void Hedger::Watch(Transfer &transfer)
+{
+    {
+        std::lock_guard lock{mMtx};
+        if(!mWatcher.joinable())
+        {
+            mWatcher = std::jthread{[this](std::stop_token stop) { WatchLoop(stop); }};
+        }
+
+        mWatched.push_back(Watched{.transfer = &transfer, .retryTime = Clock::time_point{}});
+        mIsChanged = true;
+    }
+
+    mCv.notify_all();
+}
+
+void Hedger::Unwatch(Transfer &transfer) noexcept
+{
+    auto lock = std::unique_lock{mMtx};
+    std::erase_if(mWatched, [&transfer](const Watched &watched) { return watched.transfer == &transfer; });
+    std::erase(mQueued, &transfer);
+    mCv.wait(lock, [this, &transfer]() { return std::ranges::find(mRunning, &transfer) == mRunning.end(); });
+}
+
+void Hedger::WatchLoop(std::stop_token stop)
+{
+    auto lock = std::unique_lock{mMtx};
+    while(!stop.stop_requested())
+    {
+        auto now = Clock::now();
+        auto next = std::optional<Clock::time_point>{};
+        auto numQueued = mQueued.size();
+
+        for(auto it = mWatched.begin(); it != mWatched.end();)
+        {
+            auto lastProgress = Clock::time_point{Clock::duration{it->transfer->lastProgress.load(std::memory_order_relaxed)}};
+            auto deadline = std::max(lastProgress + it->transfer->delay, it->retryTime);
+            if(deadline <= now)
+            {
+                if(mQueued.size() + mRunning.size() < mMaxHedges && !mPool->IsExhausted())
+                {
+                    mQueued.push_back(it->transfer);
+                    it = mWatched.erase(it);
+                    continue;
+                }
+
+                //Hedge is reconsidered after another delay
+                it->retryTime = now + it->transfer->delay;
+                deadline = it->retryTime;
+            }
+
+            next = next ? std::min(*next, deadline) : deadline;
+            ++it;
+        }
+
+        //Hedge just waits for busy worker if new one can't be started
+        try
+        {
+            while(mWorkers.size() < mQueued.size() + mRunning.size())
+            {
+                mWorkers.emplace_back([this](std::stop_token workerStop) { RunLoop(workerStop); });
+            }
+        }
+        catch(...) {}
+
+        if(mQueued.size() != numQueued)
+        {
+            mCv.notify_all();
+        }
+
+        mIsChanged = false;
+        if(next)
+        {
+            mCv.wait_until(lock, stop, *next, [this]() { return mIsChanged; });
+        }
+        else
+        {
+            mCv.wait(lock, stop, [this]() { return mIsChanged; });
+        }
+    }
+}
+
+void Hedger::RunLoop(std::stop_token stop)
+{
+    auto lock = std::unique_lock{mMtx};
+    while(mCv.wait(lock, stop, [this]() { return !mQueued.empty(); }))
+    {
+        auto *transfer = mQueued.front();
+        mQueued.erase(mQueued.begin());
+        mRunning.push_back(transfer);
+
+        lock.unlock();
+        try
+        {
+            transfer->hedge(transfer->stop.get_token());
+        }
+        catch(...) {}
+        lock.lock();
+
+        std::erase(mRunning, transfer);
+        mCv.notify_all();
+    }
+}
+
+
+
+FileHandle::FileHandle(const std::filesystem::path &path)
+{
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    mHandle = CreateFileW(path.c_str(),
+                          GENERIC_READ,
+                          FILE_SHARE_READ,
+                          nullptr,
+                          OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL,
+                          nullptr);
+#else
+    mHandle = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+
+    if(mHandle == InvalidHandle())
+    {
+        throw Error{Format(R"(failed to open file "{}")", path.string())};
+    }
+}
+
+FileHandle::FileHandle(Native handle) noexcept
+    : mHandle{handle}
+{
+
+}
+
+FileHandle::FileHandle(FileHandle &&other) noexcept
+    : mHandle{std::exchange(other.mHandle, InvalidHandle())}
+{
+
+}
+
+FileHandle &FileHandle::operator=(FileHandle &&other) noexcept
+{
+    if(this != &other)
+    {
+        Close();
+        mHandle = std::exchange(other.mHandle, InvalidHandle());
+    }
+
+    return *this;
+}
+
+FileHandle::~FileHandle()
+{
+    Close();
+}
+
+FileHandle FileHandle::CreateTemporary()
+{
+    auto dir = std::filesystem::temp_directory_path();
+
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    auto name = std::array<wchar_t, MAX_PATH>{};
+    if(GetTempFileNameW(dir.c_str(), L"vd", 0, name.data()) == 0)
+    {
+        throw LibraryCallError{"GetTempFileNameW", IntCast<int>(GetLastError())};
+    }
+
+    auto handle = CreateFileW(name.data(),
+                              GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_DELETE,
+                              nullptr,
+                              CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                              nullptr);
+    if(handle == InvalidHandle())
+    {
+        auto error = GetLastError();
+        DeleteFileW(name.data());
+        throw LibraryCallError{"CreateFileW", IntCast<int>(error)};
+    }
+#else
+    auto name = (dir / "vdownloader-XXXXXX").string();
+    auto handle = mkostemp(name.data(), O_CLOEXEC);
+    if(handle == InvalidHandle())
+    {
+        throw LibraryCallError{"mkostemp", errno};
+    }
+
+    //Opened file stays accessible after its name is removed
+    unlink(name.c_str());
+#endif
+
+    return FileHandle{handle};
+}
+
+std::size_t FileHandle::Size() const
+{
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(mHandle, &size))
+    {
+        throw LibraryCallError{"GetFileSizeEx", IntCast<int>(GetLastError())};
+    }
+
+    return IntCast<std::size_t>(size.QuadPart);
+#else
+    struct stat st;
+    if(fstat(mHandle, &st) != 0)
+    {
+        throw LibraryCallError{"fstat", errno};
+    }
+
+    return IntCast<std::size_t>(st.st_size);
+#endif
+}
+
+void FileHandle::ReadAt(std::size_t pos, std::span<std::byte> buf) const
+{
+    //Single call isn't guaranteed to read everything requested, also there
+    //are limits on size of single read on both platforms
+    constexpr auto maxPortion = std::size_t{1} << 30;
+
+    while(!buf.empty())
+    {
+        auto portion = std::min(buf.size_bytes(), maxPortion);
+
+#if defined(VDOWNLOADER_OS_WINDOWS)
+        auto overlapped = OVERLAPPED{};
+        overlapped.Offset = static_cast<DWORD>(pos & 0xFFFFFFFFu);
+        overlapped.OffsetHigh = static_cast<DWORD>(static_cast<std::uint64_t>(pos) >> 32);
+
+        DWORD numRead = 0;
+        if(!ReadFile(mHandle, buf.data(), static_cast<DWORD>(portion), &numRead, &overlapped))
+        {
+            throw LibraryCallError{"ReadFile", IntCast<int>(GetLastError())};
+        }
+#else
+        auto numRead = pread(mHandle, buf.data(), portion, IntCast<off_t>(pos));
+        if(numRead < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            throw LibraryCallError{"pread", errno};
+        }
+#endif
+
+        if(numRead == 0)
+        {
+            throw RangeError{"unexpected end of file"};
+        }
+
+        pos += IntCast<std::size_t>(numRead);
+        buf = buf.subspan(IntCast<std::size_t>(numRead));
+    }
+}
+
+void FileHandle::WriteAt(std::size_t pos, std::span<const std::byte> buf) const
+{
+    constexpr auto maxPortion = std::size_t{1} << 30;
+
+    while(!buf.empty())
+    {
+        auto portion = std::min(buf.size_bytes(), maxPortion);
+
+#if defined(VDOWNLOADER_OS_WINDOWS)
+        auto overlapped = OVERLAPPED{};
+        overlapped.Offset = static_cast<DWORD>(pos & 0xFFFFFFFFu);
+        overlapped.OffsetHigh = static_cast<DWORD>(static_cast<std::uint64_t>(pos) >> 32);
+
+        DWORD numWritten = 0;
+        if(!WriteFile(mHandle, buf.data(), static_cast<DWORD>(portion), &numWritten, &overlapped))
+        {
+            throw LibraryCallError{"WriteFile", IntCast<int>(GetLastError())};
+        }
+#else
+        auto numWritten = pwrite(mHandle, buf.data(), portion, IntCast<off_t>(pos));
+        if(numWritten < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            throw LibraryCallError{"pwrite", errno};
+        }
+#endif
+
+        if(numWritten == 0)
+        {
+            throw Error{"nothing is written to file"};
+        }
+
+        pos += IntCast<std::size_t>(numWritten);
+        buf = buf.subspan(IntCast<std::size_t>(numWritten));
+    }
+}
+
+FileHandle::Native FileHandle::NativeHandle() const noexcept
+{
+    return mHandle;
+}
+
+FileHandle::Native FileHandle::InvalidHandle() noexcept
+{
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    return INVALID_HANDLE_VALUE;
+#else
+    return -1;
+#endif
+}
+
+void FileHandle::Close() noexcept
+{
+    if(mHandle == InvalidHandle())
+    {
+        return;
+    }
+
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    CloseHandle(mHandle);
+#else
+    close(mHandle);
+#endif
+
+    mHandle = InvalidHandle();
+}
+
+
+
+FileMapping::FileMapping(const std::filesystem::path &path)
+{
+    auto file = FileHandle{path};
+    mSize = file.Size();
+
+    //Empty files can't be mapped, but empty span is good enough for them
+    if(mSize == 0)
+    {
+        return;
+    }
+
+    //Handle of file isn't needed after mapping is established
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    auto mapping = CreateFileMappingW(file.NativeHandle(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr)
+    {
+        throw LibraryCallError{"CreateFileMappingW", IntCast<int>(GetLastError())};
+    }
+    Defer closeMapping{[mapping]() { CloseHandle(mapping); }};
+
+    auto ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(ptr == nullptr)
+    {
+        throw LibraryCallError{"MapViewOfFile", IntCast<int>(GetLastError())};
+    }
+#else
+    auto ptr = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, file.NativeHandle(), 0);
+    if(ptr == MAP_FAILED)
+    {
+        throw LibraryCallError{"mmap", errno};
+    }
+#endif
+
+    mData = static_cast<const std::byte *>(ptr);
+}
+
+FileMapping::~FileMapping()
+{
+    if(mData == nullptr)
+    {
+        return;
+    }
+
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    UnmapViewOfFile(mData);
+#else
+    munmap(const_cast<std::byte *>(mData), mSize);
+#endif
+}
+
+std::span<const std::byte> FileMapping::Data() const noexcept
+{
+    return {mData, mSize};
+}
+
+
+
+ProgressiveBuffer::ProgressiveBuffer(std::size_t size,
+                                     std::size_t memoryLimit,
+                                     const std::shared_ptr<MemoryBudget> &budget)
+    : mSize{size},
+      mReservation{budget ? budget->ReserveUpTo(std::min(size, memoryLimit))
+                          : MemoryBudget::Reservation{}},
+      mMemorySize{budget ? mReservation.Size() : std::min(size, memoryLimit)},
+      mMemory{std::make_unique_for_overwrite<std::byte[]>(mMemorySize)}
+{
+
+}
+
+std::size_t ProgressiveBuffer::Size() const noexcept
+{
+    return mSize;
+}
+
+std::size_t ProgressiveBuffer::NumAvailable() const
+{
+    std::lock_guard lock{mMtx};
+    return mAvailable;
+}
+
+bool ProgressiveBuffer::Failed() const
+{
+    std::lock_guard lock{mMtx};
+    return mError != nullptr;
+}
+
+void ProgressiveBuffer::Append(std::span<const std::byte> data)
+{
+    //Only writer modifies number of available bytes, so it may be read
+    //without lock here
+    auto pos = mAvailable;
+    if(data.size_bytes() > mSize - pos)
+    {
+        throw RangeError{std::format("data don't fit into buffer of size {}", mSize)};
+    }
+
+    auto inMemory = pos < mMemorySize ? std::min(data.size_bytes(), mMemorySize - pos) : 0;
+    if(inMemory != 0)
+    {
+        std::memcpy(std::next(mMemory.get(), pos), data.data(), inMemory);
+    }
+
+    auto rest = data.subspan(inMemory);
+    if(!rest.empty())
+    {
+        //Readers touch file only after the first spilled byte is published
+        //under lock below
+        if(!mFile)
+        {
+            mFile.emplace(FileHandle::CreateTemporary());
+        }
+        mFile->WriteAt(pos + inMemory - mMemorySize, rest);
+    }
+
+    {
+        std::lock_guard lock{mMtx};
+        mAvailable = pos + data.size_bytes();
+    }
+    mCv.notify_all();
+}
+
+void ProgressiveBuffer::Fail(std::exception_ptr error) noexcept
+{
+    {
+        std::lock_guard lock{mMtx};
+        mError = std::move(error);
+    }
+    mCv.notify_all();
+}
+
+void ProgressiveBuffer::Read(std::size_t pos, std::span<std::byte> buf) const
+{
+    AssertRangeCorrect(pos, buf.size_bytes(), mSize);
+
+    {
+        auto end = pos + buf.size_bytes();
+        auto lock = std::unique_lock{mMtx};
+        mCv.wait(lock, [this, end]() { return mAvailable >= end || mError; });
+        //Data which have arrived before failure are still valid
+        if(mAvailable < end)
+        {
+            std::rethrow_exception(mError);
+        }
+    }
+
+    auto inMemory = pos < mMemorySize ? std::min(buf.size_bytes(), mMemorySize - pos) : 0;
+    if(inMemory != 0)
+    {
+        std::memcpy(buf.data(), std::next(mMemory.get(), pos), inMemory);
+    }
+
+    auto rest = buf.subspan(inMemory);
+    if(!rest.empty())
+    {
+        mFile->ReadAt(pos + inMemory - mMemorySize, rest);
+    }
+}
+
+
+
+namespace
+{
+
+const auto cKeyFileName = std::string{"key"};
+
+bool IsBlockFileName(const std::string &name)
+{
+    return !name.empty() && std::ranges::all_of(name, [](char c) { return c >= '0' && c <= '9'; });
+}
+
+//Blocks being written by Store
+bool IsTemporaryFileName(const std::string &name)
+{
+    return name.ends_with(".tmp");
+}
+
+std::string ReadWholeFile(const std::filesystem::path &path)
+{
+    auto in = std::ifstream(path, std::ios_base::binary);
+    return std::string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+void WriteWholeFile(const std::filesystem::path &path, std::span<const std::byte> data)
+{
+    auto of = std::ofstream(path, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    of.write(reinterpret_cast<const char *>(data.data()), IntCast<std::streamsize>(data.size_bytes()));
+    of.close();
+    if(!of)
+    {
+        throw Error{Format(R"(failed to write file "{}")", path.string())};
+    }
+}
+
+//Modification time is used to restore order of blocks on next run
+void SetLastUse(const std::filesystem::path &path) noexcept
+{
+    auto ec = std::error_code{};
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+}
+
+}//unnamed namespace
+
+DiskCache::DiskCache(const std::filesystem::path &dir, const std::string &key, std::size_t maxSize)
+    : mDir{dir / HashKey(key)},
+      mMaxSize{maxSize}
+{
+    try
+    {
+        std::filesystem::create_directories(mDir);
+
+        //Directory may belong to other key in case of hash collision
+        auto keyPath = mDir / cKeyFileName;
+        if(ReadWholeFile(keyPath) != key)
+        {
+            for(const auto &entry : std::filesystem::directory_iterator{mDir})
+            {
+                std::filesystem::remove_all(entry.path());
+            }
+
+            WriteWholeFile(keyPath, std::as_bytes(std::span{key}));
+        }
+    }
+    catch(...)
+    {
+        //Blocks can't be stored without key file, so content is just read
+        //from source
+        mIsAvailable = false;
+        return;
+    }
+
+    Scan(dir);
+    Shrink();
+}
+
+std::size_t DiskCache::TotalSize() const
+{
+    std::lock_guard lock{mMtx};
+    return mTotalSize;
+}
+
+bool DiskCache::IsAvailable() const noexcept
+{
+    return mIsAvailable;
+}
+
+const std::filesystem::path &DiskCache::Dir() const noexcept
+{
+    return mDir;
+}
+
+bool DiskCache::Load(std::size_t id, std::span<std::byte> buf)
+{
+    return Load(id, buf.size_bytes(), 0, buf);
+}
+
+bool DiskCache::Load(std::size_t id, std::size_t blockSize, std::size_t offset, std::span<std::byte> buf)
+{
+    if(offset > blockSize || buf.size_bytes() > blockSize - offset)
+    {
+        throw RangeError{};
+    }
+
+    auto path = mDir / std::to_string(id);
+    auto key = path.string();
+
+    {
+        std::lock_guard lock{mMtx};
+        auto it = mIndex.find(key);
+        if(it == mIndex.end() || it->second->size != blockSize)
+        {
+            return false;
+        }
+
+        mBlocks.splice(mBlocks.end(), mBlocks, it->second);
+    }
+
+    try
+    {
+        FileHandle{path}.ReadAt(offset, buf);
+    }
+    catch(...)
+    {
+        //File may be removed by other program instance
+        std::lock_guard lock{mMtx};
+        if(auto it = mIndex.find(key); it != mIndex.end())
+        {
+            Remove(it->second);
+        }
+        return false;
+    }
+
+    SetLastUse(path);
+    return true;
+}
+
+void DiskCache::Store(std::size_t id, std::span<const std::byte> data) noexcept
+{
+    if(!mIsAvailable || data.size_bytes() > mMaxSize)
+    {
+        return;
+    }
+
+    auto tmpPath = std::filesystem::path{};
+    try
+    {
+        auto path = mDir / std::to_string(id);
+        {
+            std::lock_guard lock{mMtx};
+            //Other program instances may write the same block at the same time
+            tmpPath = path;
+            tmpPath += Format(".{}.{}.tmp",
+                              std::hash<std::thread::id>{}(std::this_thread::get_id()),
+                              mNumStored++);
+        }
+
+        //Renaming is atomic, so nobody sees partially written block
+        WriteWholeFile(tmpPath, data);
+        std::filesystem::rename(tmpPath, path);
+        //Time set by filesystem on write may be coarser than time of usage
+        //set by Load, which breaks the order
+        SetLastUse(path);
+
+        std::lock_guard lock{mMtx};
+        auto key = path.string();
+        if(auto it = mIndex.find(key); it != mIndex.end())
+        {
+            //File is already replaced, so only bookkeeping is needed
+            mTotalSize -= it->second->size;
+            mBlocks.erase(it->second);
+            mIndex.erase(it);
+        }
+
+        auto &content = mContents[mDir.string()];
+        mBlocks.push_back(Block{.path = std::move(path), .size = data.size_bytes()});
+        try
+        {
+            mIndex.emplace(std::move(key), std::prev(mBlocks.end()));
+        }
+        catch(...)
+        {
+            mBlocks.pop_back();
+            throw;
+        }
+        content.numBlocks += 1;
+        mTotalSize += data.size_bytes();
+        Shrink();
+    }
+    catch(...)
+    {
+        auto ec = std::error_code{};
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+
+std::string DiskCache::HashKey(std::string_view key)
+{
+    //FNV-1a is used because result must be the same in every program run
+    auto hash = std::uint64_t{0xcbf29ce484222325u};
+    for(auto c : key)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3u;
+    }
+
+    return Format("{:016x}", hash);
+}
+
+void DiskCache::Scan(const std::filesystem::path &root)
+{
+    struct Found
+    {
+        Block block;
+        std::filesystem::file_time_type lastUse;
+    };
+
+    auto found = std::vector<Found>{};
+    auto ec = std::error_code{};
+    for(const auto &dir : std::filesystem::directory_iterator{root, ec})
+    {
+        if(!dir.is_directory(ec) || !std::filesystem::is_regular_file(dir.path() / cKeyFileName, ec))
+        {
+            continue;
+        }
+
+        auto content = Content{.numBlocks = 0, .sidecarsSize = 0};
+        for(const auto &file : std::filesystem::directory_iterator{dir.path(), ec})
+        {
+            auto name = file.path().filename().string();
+            if(!file.is_regular_file(ec) || name == cKeyFileName || IsTemporaryFileName(name))
+            {
+                continue;
+            }
+
+            auto size = file.file_size(ec);
+            if(ec)
+            {
+                continue;
+            }
+
+            if(!IsBlockFileName(name))
+            {
+                content.sidecarsSize += size;
+                continue;
+            }
+
+            auto lastUse = file.last_write_time(ec);
+            if(!ec)
+            {
+                found.push_back(Found{.block = Block{.path = file.path(), .size = size},
+                                      .lastUse = lastUse});
+                content.numBlocks += 1;
+            }
+        }
+
+        //All blocks of old content were evicted, but its sidecars were left
+        if(content.numBlocks == 0 && dir.path() != mDir)
+        {
+            std::filesystem::remove_all(dir.path(), ec);
+            continue;
+        }
+
+        mTotalSize += content.sidecarsSize;
+        mContents.emplace(dir.path().string(), content);
+    }
+
+    std::ranges::sort(found, std::ranges::less{}, &Found::lastUse);
+    for(auto &f : found)
+    {
+        auto key = f.block.path.string();
+        mTotalSize += f.block.size;
+        mBlocks.push_back(std::move(f.block));
+        mIndex.emplace(std::move(key), std::prev(mBlocks.end()));
+    }
+}
+
+void DiskCache::Remove(Blocks::iterator block) noexcept
+{
+    auto ec = std::error_code{};
+    std::filesystem::remove(block->path, ec);
+
+    auto dir = block->path.parent_path();
+    auto content = mContents.find(dir.string());
+    if(content != mContents.end() && --content->second.numBlocks == 0 && dir != mDir)
+    {
+        std::filesystem::remove_all(dir, ec);
+        mTotalSize -= content->second.sidecarsSize;
+        mContents.erase(content);
+    }
+
+    mTotalSize -= block->size;
+    mIndex.erase(block->path.string());
+    mBlocks.erase(block);
+}
+
+void DiskCache::Shrink() noexcept
+{
+    while(mTotalSize > mMaxSize && !mBlocks.empty())
+    {
+        Remove(mBlocks.begin());
+    }
+}
+
+}//namespace internal
+
+using namespace internal;
+
+
+
+void LruPolicy::Insert(std::size_t id)
+{
+    mOrder.push_back(id);
+    try
+    {
+        mIndex.emplace(id, std::prev(mOrder.end()));
+    }
+    catch(...)
+    {
+        mOrder.pop_back();
+        throw;
+    }
+}
+
+void LruPolicy::Touch(std::size_t id) noexcept
+{
+    mOrder.splice(mOrder.end(), mOrder, mIndex.find(id)->second);
+}
+
+void LruPolicy::Erase(std::size_t id) noexcept
+{
+    auto it = mIndex.find(id);
+    mOrder.erase(it->second);
+    mIndex.erase(it);
+}
+
+std::optional<std::size_t> LruPolicy::Evict() noexcept
+{
+    if(mOrder.empty())
+    {
+        return std::nullopt;
+    }
+
+    auto id = mOrder.front();
+    mIndex.erase(id);
+    mOrder.pop_front();
+    return id;
+}
+
+std::size_t LruPolicy::Size() const noexcept
+{
+    return mOrder.size();
+}
+
+
+
+ClockPolicy::ClockPolicy(std::size_t capacity)
+{
+    //Enough room to keep 3/4 limit
+    Rehash(std::bit_ceil(std::max(cMinCapacity, Add<std::size_t>(capacity, capacity / 3 + 1))));
+}
+
+void ClockPolicy::Insert(std::size_t id)
+{
+    if(4 * (mSize + mNumErased + 1) > 3 * mSlots.size())
+    {
+        //Erased slots are dropped by rehash, so table grows only if it's
+        //really filled
+        auto capacity = std::max(cMinCapacity, mSlots.size());
+        Rehash(4 * (mSize + 1) > 2 * capacity ? 2 * capacity : capacity);
+    }
+
+    auto mask = mSlots.size() - 1;
+    auto pos = std::hash<std::size_t>{}(id) & mask;
+    while(mSlots[pos].state == SlotState::Used)
+    {
+        pos = (pos + 1) & mask;
+    }
+
+    if(mSlots[pos].state == SlotState::Erased)
+    {
+        mNumErased -= 1;
+    }
+
+    mSlots[pos] = Slot{.id = id, .state = SlotState::Used, .isReferenced = false};
+    mSize += 1;
+}
+
+void ClockPolicy::Touch(std::size_t id) noexcept
+{
+    mSlots[Find(id)].isReferenced = true;
+}
+
+void ClockPolicy::Erase(std::size_t id) noexcept
+{
+    mSlots[Find(id)].state = SlotState::Erased;
+    mSize -= 1;
+    mNumErased += 1;
+}
+
+std::optional<std::size_t> ClockPolicy::Evict() noexcept
+{
+    if(mSize == 0)
+    {
+        return std::nullopt;
+    }
+
+    //Every referenced slot loses its bit, so it ends within two sweeps
+    auto mask = mSlots.size() - 1;
+    while(true)
+    {
+        auto &slot = mSlots[mHand];
+        mHand = (mHand + 1) & mask;
+
+        if(slot.state != SlotState::Used)
+        {
+            continue;
+        }
+
+        if(slot.isReferenced)
+        {
+            slot.isReferenced = false;
+            continue;
+        }
+
+        slot.state = SlotState::Erased;
+        mSize -= 1;
+        mNumErased += 1;
+        return slot.id;
+    }
+}
+
+std::size_t ClockPolicy::Size() const noexcept
+{
+    return mSize;
+}
+
+std::size_t ClockPolicy::Find(std::size_t id) const noexcept
+{
+    //Tracked id is always found before empty slot
+    auto mask = mSlots.size() - 1;
+    auto pos = std::hash<std::size_t>{}(id) & mask;
+    while(mSlots[pos].state != SlotState::Used || mSlots[pos].id != id)
+    {
+        pos = (pos + 1) & mask;
+    }
+
+    return pos;
+}
+
+void ClockPolicy::Rehash(std::size_t capacity)
+{
+    auto slots = std::vector<Slot>(capacity);
+    auto mask = capacity - 1;
+    for(const auto &slot : mSlots)
+    {
+        if(slot.state != SlotState::Used)
+        {
+            continue;
+        }
+
+        auto pos = std::hash<std::size_t>{}(slot.id) & mask;
+        while(slots[pos].state == SlotState::Used)
+        {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = slot;
+    }
+
+    mSlots = std::move(slots);
+    mNumErased = 0;
+    mHand = 0;
+}
+
+
+
+void TwoQueuePolicy::Insert(std::size_t id)
+{
+    //Chunk evicted recently is needed again, so it's used frequently
+    if(auto historyIt = mHistoryIndex.find(id); historyIt != mHistoryIndex.end())
+    {
+        mMain.Insert(id);
+        Forget(historyIt);
+        return;
+    }
+
+    mIn.push_back(id);
+    try
+    {
+        mInIndex.emplace(id, std::prev(mIn.end()));
+    }
+    catch(...)
+    {
+        mIn.pop_back();
+        throw;
+    }
+}
+
+void TwoQueuePolicy::Touch(std::size_t id) noexcept
+{
+    if(!mInIndex.contains(id))
+    {
+        mMain.Touch(id);
+    }
+}
+
+void TwoQueuePolicy::Erase(std::size_t id) noexcept
+{
+    if(auto it = mInIndex.find(id); it != mInIndex.end())
+    {
+        mIn.erase(it->second);
+        mInIndex.erase(it);
+        return;
+    }
+
+    mMain.Erase(id);
+}
+
+std::optional<std::size_t> TwoQueuePolicy::Evict() noexcept
+{
+    auto fromIn = !mIn.empty() &&
+                  (mMain.Size() == 0 || mIn.size() > std::max<std::size_t>(1, Size() / cInShare));
+    if(!fromIn)
+    {
+        return mMain.Evict();
+    }
+
+    auto id = mIn.front();
+    mIn.pop_front();
+    mInIndex.erase(id);
+
+    //History is hint only, it's fine to lose it
+    try
+    {
+        Remember(id);
+    }
+    catch(...) {}
+
+    return id;
+}
+
+std::size_t TwoQueuePolicy::Size() const noexcept
+{
+    return mIn.size() + mMain.Size();
+}
+
+void TwoQueuePolicy::Remember(std::size_t id)
 {
-    auto parsed = ada::parse(url);
-    if(!parsed.has_value())
+    mHistory.push_back(id);
+    try
     {
-        throw ArgumentError{std::format(R"("{}" is not a valid url)", url)};
+        mHistoryIndex.insert_or_assign(id, std::prev(mHistory.end()));
+    }
+    catch(...)
+    {
+        mHistory.pop_back();
+        throw;
     }
 
-    auto components = parsed->get_components();
-    if(components.pathname_start >= url.size())
+    //History is as long as queues, so ids evicted before all current chunks
+    //were inserted are forgotten
+    while(mHistory.size() > std::max(cMinHistory, Size()))
     {
-        return "/";
+        Forget(mHistoryIndex.find(mHistory.front()));
     }
+}
 
-    return url.substr(components.pathname_start);
+void TwoQueuePolicy::Forget(QueueIndex::iterator it) noexcept
+{
+    mHistory.erase(it->second);
+    mHistoryIndex.erase(it);
 }
 
-}//namespace internal
 
-using namespace internal;
 
+HttpSource::Download::Download(std::size_t size,
+                               std::size_t memoryLimit,
+                               const std::shared_ptr<MemoryBudget> &budget)
+    : buffer{size, memoryLimit, budget}
+{
 
+}
 
-HttpSource::HttpSource(const std::string &url)
+HttpSource::HttpSource(const std::string &url,
+                       std::size_t maxConnections,
+                       std::size_t memoryLimit,
+                       std::shared_ptr<MemoryBudget> budget,
+                       std::size_t initialSize)
+    : mDownloadMtx{std::make_unique<std::mutex>()},
+      mMemoryLimit{budget ? std::min(memoryLimit, budget->Limit() / 2) : memoryLimit},
+      mBudget{std::move(budget)},
+      mMultipartRetryTime{std::make_unique<std::atomic<std::chrono::steady_clock::rep>>(0)},
+      mLatency{std::make_unique<LatencyTracker>()}
 {
-    auto headers = EstablishConnection(url);
-    auto lookupRes = headers.equal_range("Content-Length");
-    if(lookupRes.first == headers.end())
+    auto headers = initialSize != 0 ? ReceiveInitial(url, maxConnections, initialSize) : std::nullopt;
+    if(headers)
     {
-        throw NotFoundError{R"(response doesn't contain header "Content-Length")"};
+        mIsRangeSupported = true;
     }
+    else
+    {
+        headers = EstablishConnection(url, maxConnections);
+        auto lookupRes = headers->equal_range("Content-Length");
+        if(lookupRes.first == headers->end())
+        {
+            throw NotFoundError{R"(response doesn't contain header "Content-Length")"};
+        }
+
+        mContentLength = StrToUint<decltype(mContentLength)>(lookupRes.first->second);
 
-    mContentLength = StrToUint<decltype(mContentLength)>(lookupRes.first->second);
+        mIsRangeSupported = false;
+        lookupRes = headers->equal_range("Accept-Ranges");
+        if(lookupRes.first != headers->end() &&
+           lookupRes.first->second == "bytes")
+        {
+            mIsRangeSupported = true;
+        }
+    }
 
-    mIsRangeSupported = false;
-    lookupRes = headers.equal_range("Accept-Ranges");
-    if(lookupRes.first != headers.end() &&
-       lookupRes.first->second == "bytes")
+    //Weak ETag doesn't guarantee byte-for-byte equality, so it's not used
+    mCacheKey = url;
+    auto etag = headers->find("ETag");
+    if(etag != headers->end() && !etag->second.starts_with("W/"))
     {
-        mIsRangeSupported = true;
+        mCacheKey += "\nETag: " + etag->second;
+    }
+    if(auto lastModified = headers->find("Last-Modified"); lastModified != headers->end())
+    {
+        mCacheKey += "\nLast-Modified: " + lastModified->second;
+    }
+    mCacheKey += "\nContent-Length: " + std::to_string(mContentLength);
+
+    //Hedged request would just wait for connection of primary one
+    if(mIsRangeSupported && mPool->MaxClients() > 1)
+    {
+        mHedger = std::make_unique<Hedger>(mPool, mPool->MaxClients() - 1);
     }
 }
 
@@ -93,6 +2157,16 @@ std::size_t HttpSource::GetContentLength() const noexcept
     return mContentLength;
 }
 
+const std::string &HttpSource::GetCacheKey() const noexcept
+{
+    return mCacheKey;
+}
+
+std::size_t HttpSource::GetMaxConcurrentReads() const noexcept
+{
+    return mIsRangeSupported ? mPool->MaxClients() : 0;
+}
+
 void HttpSource::Read(std::size_t pos, std::span<std::byte> buf)
 {
     //This precondition is essential for next checks
@@ -103,6 +2177,11 @@ void HttpSource::Read(std::size_t pos, std::span<std::byte> buf)
 
     AssertRangeCorrect(pos, buf.size_bytes(), GetContentLength());
 
+    if(ReadInitial(pos, buf))
+    {
+        return;
+    }
+
     constexpr auto fromMax = std::numeric_limits<decltype(Range::first)>::max();
     constexpr auto toMax = std::numeric_limits<decltype(Range::second)>::max();
     auto from = pos;
@@ -114,37 +2193,92 @@ void HttpSource::Read(std::size_t pos, std::span<std::byte> buf)
 
     if(mIsRangeSupported)
     {
-        auto range = make_range_header({{from, to}});
-        auto requestRes = mHttpClient->Get(mRequestStr, {range});
-        const auto &response = AssertRequestSuccessful(requestRes, PartialContent_206);
-        auto body = response.body;
-        AssertResponseLengthCorrect(buf.size_bytes(), body.size());
-
-        std::memcpy(buf.data(), body.data(), body.size());
+        ReceiveRange(pos,
+                     buf.size_bytes(),
+                     [buf, received = std::size_t{0}](std::span<const std::byte> data) mutable
+                     {
+                         std::memcpy(std::next(buf.data(), received), data.data(), data.size_bytes());
+                         received += data.size_bytes();
+                     });
         return;
     }
     else
     {
-        if(mCache.empty())
+        GetDownload()->buffer.Read(from, buf);
+        return;
+    }
+}
+
+void HttpSource::ReadV(std::span<const ReadRequest> requests)
+{
+    auto remaining = std::vector<ReadRequest>{};
+    for(const auto &request : requests)
+    {
+        AssertRangeCorrect(request.pos, request.buf.size_bytes(), GetContentLength());
+        if(!ReadInitial(request.pos, request.buf))
+        {
+            remaining.push_back(request);
+        }
+    }
+    requests = remaining;
+
+    if(!mIsRangeSupported)
+    {
+        for(const auto &request : requests)
         {
-            Cache();
+            Read(request.pos, request.buf);
         }
-        
-        std::memcpy(buf.data(), std::next(mCache.data(), from), buf.size_bytes());
         return;
     }
+
+    auto grouped = GroupAdjacent(requests);
+    auto groups = std::span<const RequestGroup>{grouped};
+
+    //Response which isn't multipart may be caused by intermediary or server
+    //load, so multipart requests are tried again later
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    while(groups.size() > 1 && now >= mMultipartRetryTime->load(std::memory_order_relaxed))
+    {
+        auto batch = groups.first(std::min(groups.size(), cMaxRangesPerRequest));
+        if(!ReceiveMultipart(batch))
+        {
+            auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(cMultipartRetryDelay);
+            mMultipartRetryTime->store(now + delay.count(), std::memory_order_relaxed);
+            break;
+        }
+
+        groups = groups.subspan(batch.size());
+    }
+
+    for(const auto &group : groups)
+    {
+        ReceiveGroup(group);
+    }
+}
+
+std::optional<SourceView> HttpSource::View(std::size_t pos, std::size_t len)
+{
+    AssertRangeCorrect(pos, len, GetContentLength());
+
+    if(!mInitial || len > mInitial->data.size() || pos > mInitial->data.size() - len)
+    {
+        return std::nullopt;
+    }
+
+    return SourceView{.data = std::span{mInitial->data}.subspan(pos, len),
+                      .owner = mInitial};
 }
 
-httplib::Headers HttpSource::EstablishConnection(std::string url)
+httplib::Headers HttpSource::EstablishConnection(std::string url, std::size_t maxConnections)
 {
     //Not good if infinite redirection is possible
     while(true)
     {
         mRequestStr = ExtractPathAndQuery(url);
-        mHttpClient = std::make_unique<Client>(std::string{ExtractAddress(url)});
-        mHttpClient->set_keep_alive(true);
-        mHttpClient->set_follow_location(true);
-        auto requestRes = mHttpClient->Head(mRequestStr);
+        auto address = std::string{ExtractAddress(url)};
+        auto client = ClientPool::MakeClient(address);
+        auto requestRes = client->Head(mRequestStr);
+        mPool = std::make_shared<ClientPool>(address, maxConnections, std::move(client));
         const auto &response = AssertRequestSuccessful(requestRes);
     
         //Must be filled only when redirection happened
@@ -159,16 +2293,540 @@ httplib::Headers HttpSource::EstablishConnection(std::string url)
     }
 }
 
-void HttpSource::Cache()
+std::optional<httplib::Headers> HttpSource::ReceiveInitial(const std::string &url,
+                                                           std::size_t maxConnections,
+                                                           std::size_t size)
+{
+    auto requestStr = std::string{ExtractPathAndQuery(url)};
+    auto address = std::string{ExtractAddress(url)};
+    auto client = ClientPool::MakeClient(address);
+
+    auto data = std::vector<std::byte>{};
+    auto isPartial = false;
+    auto isTooLong = false;
+    auto requestRes =
+        client->Get(
+            requestStr,
+            {make_range_header({{0, IntCast<decltype(Range::second)>(size - 1)}})},
+            [&isPartial](const Response &response)
+            {
+                //Body of other responses (e.g. whole content if range is
+                //ignored) isn't needed, status is reported by HEAD then
+                isPartial = response.status == PartialContent_206;
+                return isPartial;
+            },
+            [&data, &isTooLong, size](const char *bytes, std::size_t len)
+            {
+                if(len > size - data.size())
+                {
+                    isTooLong = true;
+                    return false;
+                }
+
+                auto begin = reinterpret_cast<const std::byte *>(bytes);
+                data.insert(data.end(), begin, std::next(begin, len));
+                return true;
+            });
+
+    //Failures are reported by HEAD, which is issued then
+    if(!isPartial || isTooLong || requestRes.error() != httplib::Error::Success)
+    {
+        return std::nullopt;
+    }
+
+    //Server declaring no range support is trusted, partial content is
+    //probably produced by some intermediary then
+    const auto &response = requestRes.value();
+    if(response.get_header_value("Accept-Ranges") == "none")
+    {
+        return std::nullopt;
+    }
+
+    //Missing or malformed range is handled by HEAD as well
+    auto length = std::optional<std::size_t>{};
+    try
+    {
+        auto contentRange = response.get_header_value("Content-Range");
+        length = ParseContentRangeLength(contentRange);
+        if(!length || ParseContentRange(contentRange) != std::pair{std::size_t{0}, data.size() - 1})
+        {
+            return std::nullopt;
+        }
+    }
+    catch(const Error &)
+    {
+        return std::nullopt;
+    }
+
+    //Redirections are followed by client, so final address is known only
+    //now and client is connected to the first one
+    if(!response.location.empty())
+    {
+        requestStr = ExtractPathAndQuery(response.location);
+        address = ExtractAddress(response.location);
+        client.reset();
+    }
+
+    mRequestStr = std::move(requestStr);
+    mPool = std::make_shared<ClientPool>(std::move(address), maxConnections, std::move(client));
+    mContentLength = *length;
+
+    auto reservation = mBudget ? mBudget->Reserve(data.size()) : MemoryBudget::Reservation{};
+    mInitial = std::make_shared<const Initial>(std::move(data), std::move(reservation));
+    return response.headers;
+}
+
+bool HttpSource::ReadInitial(std::size_t pos, std::span<std::byte> buf) const noexcept
+{
+    if(!mInitial || buf.size_bytes() > mInitial->data.size() || pos > mInitial->data.size() - buf.size_bytes())
+    {
+        return false;
+    }
+
+    std::memcpy(buf.data(), std::next(mInitial->data.data(), pos), buf.size_bytes());
+    return true;
+}
+
+std::shared_ptr<HttpSource::Download> HttpSource::GetDownload()
+{
+    std::lock_guard lock{*mDownloadMtx};
+    if(mDownload && !mDownload->buffer.Failed())
+    {
+        return mDownload;
+    }
+
+    //Readers of failed download still hold it, so it's just replaced
+    auto download = std::make_shared<Download>(mContentLength, mMemoryLimit, mBudget);
+    download->thread = std::jthread{
+        [pool = mPool, requestStr = mRequestStr, &buffer = download->buffer](std::stop_token stop)
+        {
+            try
+            {
+                ReceiveBody(*pool,
+                            requestStr,
+                            {},
+                            OK_200,
+                            buffer.Size(),
+                            [&buffer](std::span<const std::byte> data) { buffer.Append(data); },
+                            stop);
+            }
+            catch(...)
+            {
+                buffer.Fail(std::current_exception());
+            }
+        }};
+
+    mDownload = download;
+    return download;
+}
+
+void HttpSource::ReceiveRange(std::size_t pos, std::size_t size, const Sink &sink)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto mtx = std::mutex{};
+    auto committed = std::size_t{0};
+    auto hedged = Hedger::Transfer{};
+    hedged.lastProgress.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+
+    //Returns when whole range is received or stop is requested. Both primary
+    //and hedged transfers deliver the same bytes, so only those which weren't
+    //committed yet are passed to sink
+    auto transfer =
+        [this, pos, size, &sink, &mtx, &committed, &hedged](std::stop_token stop)
+        {
+            auto numFailures = std::size_t{0};
+            while(true)
+            {
+                auto from = std::size_t{0};
+                {
+                    std::lock_guard lock{mtx};
+                    from = committed;
+                }
+
+                if(from == size)
+                {
+                    return;
+                }
+
+                auto offset = from;
+                auto start = Clock::now();
+                auto range = make_range_header({{IntCast<decltype(Range::first)>(pos + from),
+                                                 IntCast<decltype(Range::second)>(pos + size - 1)}});
+
+                try
+                {
+                    ReceiveBody(*mPool,
+                                mRequestStr,
+                                {range},
+                                PartialContent_206,
+                                size - from,
+                                [&](std::span<const std::byte> data)
+                                {
+                                    auto now = Clock::now();
+                                    if(offset == from)
+                                    {
+                                        mLatency->Add(now - start);
+                                    }
+
+                                    std::lock_guard lock{mtx};
+                                    auto end = offset + data.size_bytes();
+                                    if(end > committed)
+                                    {
+                                        sink(data.subspan(committed - offset));
+                                        committed = end;
+                                        //Deadline is compared with time without
+                                        //progress rather than with duration of
+                                        //whole request, so it doesn't depend on
+                                        //size of range
+                                        hedged.lastProgress.store(now.time_since_epoch().count(),
+                                                                  std::memory_order_relaxed);
+                                    }
+                                    offset = end;
+                                },
+                                stop);
+                    return;
+                }
+                catch(const HttplibError &)
+                {
+                    if(stop.stop_requested())
+                    {
+                        return;
+                    }
+
+                    numFailures = offset > from ? 1 : numFailures + 1;
+                    if(numFailures > cMaxFailedResumes)
+                    {
+                        throw;
+                    }
+                }
+            }
+        };
+
+    auto deadline = GetHedgeDeadline();
+    if(!deadline)
+    {
+        transfer(std::stop_token{});
+        return;
+    }
+
+    auto primaryStop = std::stop_source{};
+    auto hedgeError = std::exception_ptr{};
+    hedged.delay = *deadline;
+    hedged.hedge =
+        [&transfer, &primaryStop, &hedgeError](std::stop_token stop)
+        {
+            try
+            {
+                transfer(stop);
+                primaryStop.request_stop();
+            }
+            catch(...)
+            {
+                hedgeError = std::current_exception();
+            }
+        };
+    mHedger->Watch(hedged);
+
+    auto primaryError = std::exception_ptr{};
+    try
+    {
+        transfer(primaryStop.get_token());
+    }
+    catch(...)
+    {
+        primaryError = std::current_exception();
+    }
+
+    //Failed primary transfer may still be completed by hedged one
+    if(!primaryError)
+    {
+        hedged.stop.request_stop();
+    }
+    mHedger->Unwatch(hedged);
+
+    if(committed != size)
+    {
+        std::rethrow_exception(primaryError ? primaryError : hedgeError);
+    }
+}
+
+std::optional<LatencyTracker::Duration> HttpSource::GetHedgeDeadline() const
+{
+    if(!mHedger)
+    {
+        return std::nullopt;
+    }
+
+    auto percentile = mLatency->Percentile(cHedgePercentile);
+    if(!percentile)
+    {
+        return std::nullopt;
+    }
+
+    return std::max<LatencyTracker::Duration>(*percentile, cMinHedgeDelay);
+}
+
+void HttpSource::ReceiveGroup(const RequestGroup &group)
+{
+    ReceiveRange(group.pos,
+                 group.size,
+                 [&group, pos = group.pos](std::span<const std::byte> data) mutable
+                 {
+                     CopyOverlap(pos, data, group.requests);
+                     pos += data.size_bytes();
+                 });
+}
+
+bool HttpSource::ReceiveMultipart(std::span<const RequestGroup> groups)
+{
+    auto ranges = Ranges{};
+    auto maxBodySize = std::size_t{0};
+    for(const auto &group : groups)
+    {
+        ranges.emplace_back(IntCast<decltype(Range::first)>(group.pos),
+                            IntCast<decltype(Range::second)>(group.pos + group.size - 1));
+        //Headers of every part take much less than that
+        maxBodySize += group.size + 1024;
+    }
+
+    //Server is allowed to merge ranges, so parts don't necessary correspond
+    //to groups, received ranges are merged to check that they cover all
+    //of them
+    auto received = std::vector<std::pair<std::size_t, std::size_t>>{};
+    auto parser = std::optional<ByteRangesParser>{};
+    auto sink =
+        [&groups, &received](std::size_t pos, std::span<const std::byte> data)
+        {
+            for(const auto &group : groups)
+            {
+                CopyOverlap(pos, data, group.requests);
+            }
+
+            if(!received.empty() && received.back().second == pos)
+            {
+                received.back().second += data.size_bytes();
+            }
+            else
+            {
+                received.emplace_back(pos, pos + data.size_bytes());
+            }
+        };
+
+    auto client = mPool->Acquire();
+
+    auto unexpectedStatus = std::optional<int>{};
+    auto reason = std::string{};
+    auto bodySize = std::size_t{0};
+    auto isTooLong = false;
+    auto parseError = std::exception_ptr{};
+
+    auto requestRes =
+        client->Get(
+            mRequestStr,
+            {make_range_header(ranges)},
+            [&unexpectedStatus, &reason, &parser, &sink](const Response &response)
+            {
+                //Server may ignore ranges or send only some of them
+                if(response.status == OK_200 ||
+                   response.status == PartialContent_206)
+                {
+                    //Exceptions must not pass through httplib, response
+                    //without valid boundary is just unsupported one
+                    try
+                    {
+                        if(auto boundary = ExtractByteRangesBoundary(response.get_header_value("Content-Type")))
+                        {
+                            parser.emplace(*boundary, sink);
+                        }
+                    }
+                    catch(...) {}
+
+                    return parser.has_value();
+                }
+
+                unexpectedStatus = response.status;
+                reason = response.reason;
+                return false;
+            },
+            [&parser, &bodySize, &isTooLong, &parseError, maxBodySize](const char *data, std::size_t len)
+            {
+                if(len > maxBodySize - bodySize)
+                {
+                    isTooLong = true;
+                    return false;
+                }
+                bodySize += len;
+
+                //Exceptions must not pass through httplib
+                try
+                {
+                    parser->Feed({data, len});
+                }
+                catch(...)
+                {
+                    parseError = std::current_exception();
+                    return false;
+                }
+
+                return true;
+            });
+
+    if(unexpectedStatus)
+    {
+        throw HttpError{*unexpectedStatus,
+                        reason,
+                        mPool->Address() + mRequestStr};
+    }
+
+    if(!parser)
+    {
+        return false;
+    }
+
+    if(isTooLong)
+    {
+        throw Error{"multipart/byteranges response body is too long"};
+    }
+
+    if(parseError)
+    {
+        std::rethrow_exception(parseError);
+    }
+
+    if(requestRes.error() != httplib::Error::Success)
+    {
+        throw HttplibError{requestRes.error()};
+    }
+
+    parser->Finish();
+
+    std::ranges::sort(received);
+    auto merged = std::vector<std::pair<std::size_t, std::size_t>>{};
+    for(const auto &range : received)
+    {
+        if(!merged.empty() && range.first <= merged.back().second)
+        {
+            merged.back().second = std::max(merged.back().second, range.second);
+        }
+        else
+        {
+            merged.push_back(range);
+        }
+    }
+
+    for(const auto &group : groups)
+    {
+        auto covered = std::ranges::any_of(
+            merged,
+            [&group](const std::pair<std::size_t, std::size_t> &range)
+            {
+                return range.first <= group.pos && range.second >= group.pos + group.size;
+            });
+        if(!covered)
+        {
+            throw Error{std::format("multipart/byteranges response doesn't contain range {}-{}",
+                                    group.pos,
+                                    group.pos + group.size - 1)};
+        }
+    }
+
+    return true;
+}
+
+void HttpSource::ReceiveBody(ClientPool &pool,
+                             const std::string &requestStr,
+                             const Headers &headers,
+                             StatusCode expectedCode,
+                             std::size_t size,
+                             const Sink &sink,
+                             std::stop_token stop)
 {
-    auto requestRes = mHttpClient->Get(mRequestStr);
-    const auto &response = AssertRequestSuccessful(requestRes);
+    auto client = pool.Acquire(stop);
+    //Request may have become unnecessary while connection was awaited
+    if(stop.stop_requested())
+    {
+        throw HttplibError{httplib::Error::Canceled};
+    }
+
+    //Aborts request blocked on socket
+    auto stopCallback = std::stop_callback{stop, [&client]() { client->stop(); }};
+
+    auto unexpectedStatus = std::optional<int>{};
+    auto reason = std::string{};
+    auto received = std::size_t{0};
+    auto sinkError = std::exception_ptr{};
+
+    auto requestRes =
+        client->Get(
+            requestStr,
+            headers,
+            [&unexpectedStatus, &reason, expectedCode](const Response &response)
+            {
+                if(response.status != expectedCode)
+                {
+                    unexpectedStatus = response.status;
+                    reason = response.reason;
+                    return false;
+                }
+
+                return true;
+            },
+            [&sink, &received, &sinkError, &stop, size](const char *data, std::size_t len)
+            {
+                //Too long body is an error anyway, so we just stop receiving
+                if(len > size - received)
+                {
+                    received = size + 1;
+                    return false;
+                }
+
+                if(stop.stop_requested())
+                {
+                    return false;
+                }
+
+                //Exceptions must not pass through httplib
+                try
+                {
+                    sink({reinterpret_cast<const std::byte *>(data), len});
+                }
+                catch(...)
+                {
+                    sinkError = std::current_exception();
+                    return false;
+                }
+
+                received += len;
+                return true;
+            });
+
+    //Receiving is canceled in case of unexpected status, so it must be
+    //checked before request error
+    if(unexpectedStatus)
+    {
+        throw HttpError{*unexpectedStatus,
+                        reason,
+                        pool.Address() + requestStr};
+    }
 
-    auto body = response.body;
-    AssertResponseLengthCorrect(mContentLength, body.size());
+    if(received > size)
+    {
+        throw Error{std::format("response body is longer than requested content length ({})",
+                                size)};
+    }
+
+    if(sinkError)
+    {
+        std::rethrow_exception(sinkError);
+    }
+
+    if(requestRes.error() != httplib::Error::Success)
+    {
+        throw HttplibError{requestRes.error()};
+    }
 
-    mCache.resize(body.size());
-    std::memcpy(mCache.data(), body.data(), body.size());
+    AssertResponseLengthCorrect(size, received);
 }
 
 const Response &HttpSource::AssertRequestSuccessful(
@@ -184,7 +2842,7 @@ const Response &HttpSource::AssertRequestSuccessful(
     {
         throw HttpError{response.status,
                         response.reason,
-                        mHttpClient->host() + mRequestStr};
+                        mPool->Address() + mRequestStr};
     }
 
     return response;
@@ -220,22 +2878,21 @@ void MemoryViewSource::Read(std::size_t pos, std::span<std::byte> buf)
     std::memcpy(buf.data(), mBuf.data() + pos, buf.size_bytes());
 }
 
+std::optional<SourceView> MemoryViewSource::View(std::size_t pos, std::size_t len)
+{
+    AssertRangeCorrect(pos, len, GetContentLength());
+
+    return SourceView{.data = mBuf.subspan(pos, len), .owner = nullptr};
+}
+
 
 
-//It's not clear if all this trickery with tellg/ignore is really needed,
-//but it looks like most correct way to deal with ifstream
 FileSource::FileSource(const std::filesystem::path &path)
+    : mFile{path}
 {
-    mFile.open(path, std::ios_base::in | std::ios_base::binary);
-    if(!mFile)
-    {
-        throw Error{Format(R"(failed to open file "{}")", path.string())};
-    }
-
     try
     {
-        mStart = mFile.tellg();
-        mSize = IntCast<decltype(mSize)>(std::filesystem::file_size(path));
+        mSize = mFile.Size();
     }
     catch(std::exception &e)
     {
@@ -259,13 +2916,7 @@ void FileSource::Read(std::size_t pos, std::span<std::byte> buf)
 
     try
     {
-        mFile.seekg(mStart);
-        mFile.ignore(IntCast<std::streamsize>(pos));
-        mFile.read(reinterpret_cast<char *>(buf.data()), IntCast<std::streamsize>(buf.size_bytes()));
-        if(!mFile)
-        {
-            throw std::exception{};
-        }
+        mFile.ReadAt(pos, buf);
     }
     catch(std::exception &e)
     {
@@ -275,6 +2926,44 @@ void FileSource::Read(std::size_t pos, std::span<std::byte> buf)
 
 
 
+MappedFileSource::MappedFileSource(const std::filesystem::path &path)
+{
+    try
+    {
+        mMapping = std::make_shared<const FileMapping>(path);
+    }
+    catch(std::exception &e)
+    {
+        throw Error{Format(R"(failed to map file "{}": "{}")", path.string(), std::string{e.what()})};
+    }
+}
+
+std::size_t MappedFileSource::GetContentLength() const noexcept
+{
+    return mMapping->Data().size_bytes();
+}
+
+void MappedFileSource::Read(std::size_t pos, std::span<std::byte> buf)
+{
+    if(buf.size_bytes() == 0)
+    {
+        return;
+    }
+
+    auto view = *View(pos, buf.size_bytes());
+    std::memcpy(buf.data(), view.data.data(), buf.size_bytes());
+}
+
+std::optional<SourceView> MappedFileSource::View(std::size_t pos, std::size_t len)
+{
+    AssertRangeCorrect(pos, len, GetContentLength());
+
+    return SourceView{.data = mMapping->Data().subspan(pos, len),
+                      .owner = mMapping};
+}
+
+
+
 std::size_t SourceBase::GetContentLength() const
 {
     return GetContentLengthOverride();
@@ -285,4 +2974,9 @@ void SourceBase::Read(std::size_t pos, std::span<std::byte> buf)
     return ReadOverride(pos, buf);
 }
 
+std::optional<SourceView> SourceBase::View(std::size_t pos, std::size_t len)
+{
+    return ViewOverride(pos, len);
+}
+
 } //namespace vd
\ No newline at end of file
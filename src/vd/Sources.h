@@ -7,17 +7,33 @@
 #include <httplib.h>
 
 #include "Errors.h"
+#include "Preprocessor.h"
 #include "Utils.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <list>
+#include <limits>
 #include <mutex>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
 #include <span>
 #include <string>
 #include <filesystem>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace vd
@@ -32,293 +48,2485 @@ concept SourceConcept =
         { v.Read(pos, buf) } -> std::same_as<void>;
     };
 
+//Sources declaring static constexpr member cConcurrentReads equal to true
+//promise that Read may be invoked from multiple threads simultaneously
+//without any external synchronization
+template <class T>
+concept ConcurrentSourceConcept =
+    SourceConcept<T> &&
+    requires { requires T::cConcurrentReads; };
+
+//Concurrent sources serving only limited number of reads in parallel (e.g.
+//one per connection), further reads wait for earlier ones. Zero means that
+//number isn't limited
+template <class T>
+concept LimitedConcurrencySourceConcept =
+    ConcurrentSourceConcept<T> &&
+    requires(const T cv)
+    {
+        { cv.GetMaxConcurrentReads() } -> std::same_as<std::size_t>;
+    };
+
+//Returns 0 if number of reads in parallel isn't limited
+template <SourceConcept SourceT>
+std::size_t GetMaxConcurrentReads(const SourceT &source)
+{
+    if constexpr(LimitedConcurrencySourceConcept<SourceT>)
+    {
+        return source.GetMaxConcurrentReads();
+    }
+    else
+    {
+        return ConcurrentSourceConcept<SourceT> ? 0 : 1;
+    }
+}
+
+//Read-only span into memory lent by source. Owner keeps that memory alive
+//as long as view exists, it's empty when memory isn't owned by source
+struct SourceView final
+{
+    std::span<const std::byte> data;
+    std::shared_ptr<const void> owner;
+};
+
+//Sources able to lend their memory instead of copying it. View returns
+//nullopt when requested range can't be lent, Read must be used then
+template <class T>
+concept ViewableSourceConcept =
+    SourceConcept<T> &&
+    requires(T v, std::size_t pos, std::size_t len)
+    {
+        { v.View(pos, len) } -> std::same_as<std::optional<SourceView>>;
+    };
+
+//Sources able to identify their content across program runs. Equal keys
+//must mean equal content, so key has to change whenever content changes
+template <class T>
+concept KeyedSourceConcept =
+    SourceConcept<T> &&
+    requires(const T cv)
+    {
+        { cv.GetCacheKey() } -> std::convertible_to<std::string>;
+    };
+
+//Single range of vectored read
+struct ReadRequest final
+{
+    std::size_t pos;
+    std::span<std::byte> buf;
+};
+
+//Sources able to read several ranges at once cheaper than one by one, e.g.
+//by merging them into single request
+template <class T>
+concept VectoredSourceConcept =
+    SourceConcept<T> &&
+    requires(T v, std::span<const ReadRequest> requests)
+    {
+        { v.ReadV(requests) } -> std::same_as<void>;
+    };
+
+//Ranges are read one by one if source doesn't support vectored reads
+template <SourceConcept SourceT>
+void ReadV(SourceT &source, std::span<const ReadRequest> requests)
+{
+    if constexpr(VectoredSourceConcept<SourceT>)
+    {
+        source.ReadV(requests);
+    }
+    else
+    {
+        for(const auto &request : requests)
+        {
+            source.Read(request.pos, request.buf);
+        }
+    }
+}
+
+
+
+//Classes of fetches issued by caches, from most to least urgent
+enum class FetchPriority
+{
+    //Reader is blocked until data arrive
+    Demand,
+    //Data needed soon by every reader, e.g. container index
+    Metadata,
+    //Data which may be needed, e.g. read-ahead
+    Speculative
+};
+
+//Accountant of memory used by caches, it's meant to be shared by all sources
+//and cache tiers of the process. Limit isn't enforced by accountant itself,
+//caches reserve memory before allocating and discard their own content to
+//make room. Budget must be owned by shared_ptr, reservations keep it alive
+class MemoryBudget final : public std::enable_shared_from_this<MemoryBudget>
+{
+public:
+    //Reserved memory is returned into budget on destruction
+    class Reservation final
+    {
+    public:
+        Reservation() = default;
+        Reservation(const Reservation &) = delete;
+        Reservation &operator=(const Reservation &) = delete;
+        Reservation(Reservation &&other) noexcept;
+        Reservation &operator=(Reservation &&other) noexcept;
+        ~Reservation();
+
+        std::size_t Size() const noexcept;
+
+    private:
+        friend class MemoryBudget;
+
+        std::shared_ptr<MemoryBudget> mBudget;
+        std::size_t mSize{0};
+
+        Reservation(std::shared_ptr<MemoryBudget> budget, std::size_t size) noexcept;
+        void Release() noexcept;
+    };
+
+    explicit MemoryBudget(std::size_t limit);
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    std::size_t Limit() const noexcept;
+    std::size_t Used() const noexcept;
+    //Returns nullopt if limit would be exceeded
+    std::optional<Reservation> TryReserve(std::size_t size);
+    //Reserves as much as available but not more than size
+    Reservation ReserveUpTo(std::size_t size);
+    //Always succeeds, so limit may be exceeded
+    Reservation Reserve(std::size_t size);
+
+private:
+    const std::size_t mLimit;
+    std::atomic<std::size_t> mUsed{0};
+};
+
+//Pool of equally sized uninitialized buffers for cached chunks. Released
+//blocks are kept for reuse (up to maxFree), so quickly cycling cache neither
+//allocates nor faults in fresh memory for every chunk. Blocks may be backed
+//by transparent huge pages, it's ignored where unsupported. Arena must be
+//owned by shared_ptr, blocks keep it alive.
+//Blocks in use are accounted by their users, but if budget is given, free
+//blocks are kept only while it has room for them, and Trim frees those which
+//don't fit anymore
+class ChunkArena final : public std::enable_shared_from_this<ChunkArena>
+{
+public:
+    //Memory is returned into arena on destruction
+    class Block final
+    {
+    public:
+        Block() = default;
+        Block(const Block &) = delete;
+        Block &operator=(const Block &) = delete;
+        Block(Block &&other) noexcept;
+        Block &operator=(Block &&other) noexcept;
+        ~Block();
+
+        std::span<std::byte> Data() const noexcept;
+
+    private:
+        friend class ChunkArena;
+
+        std::shared_ptr<ChunkArena> mArena;
+        std::byte *mData{nullptr};
+
+        Block(std::shared_ptr<ChunkArena> arena, std::byte *data) noexcept;
+        void Release() noexcept;
+    };
+
+    ChunkArena(std::size_t blockSize,
+               std::size_t maxFree,
+               bool useHugePages = false,
+               std::shared_ptr<MemoryBudget> budget = nullptr);
+    ChunkArena(const ChunkArena &) = delete;
+    ChunkArena &operator=(const ChunkArena &) = delete;
+    ~ChunkArena();
+
+    std::size_t BlockSize() const noexcept;
+    //Memory taken by block, it's rounded up to huge page if they're used
+    std::size_t MemorySize() const noexcept;
+    std::size_t NumFree() const;
+    Block Allocate();
+    //Frees blocks not fitting into room left in budget
+    void Trim() noexcept;
+
+private:
+    static const std::size_t cHugePageSize = 1 << 21;
+
+    const std::size_t mBlockSize;
+    const std::size_t mMaxFree;
+    //Huge pages are used only if block fills one at least
+    const bool mUseHugePages;
+    //Block size rounded up to huge page if they're used
+    const std::size_t mMemorySize;
+    const std::shared_ptr<MemoryBudget> mBudget;
+    std::vector<std::byte *> mFree;
+    mutable std::mutex mMtx;
+
+    //Must be called with lock held
+    std::size_t GetMaxFree() const noexcept;
+    std::byte *AllocateMemory();
+    void FreeMemory(std::byte *data) noexcept;
+    void Release(std::byte *data) noexcept;
+};
+
+
+
+//Head is beginning of MP4 content. If media data box (mdat) precedes movie
+//box (moov) and runs past head, returns position of box following it,
+//where moov is expected then. Returns nullopt for "faststart" files and
+//if head isn't MP4 or can't be parsed
+std::optional<std::size_t> FindTrailingMp4Metadata(std::span<const std::byte> head,
+                                                   std::size_t contentLength);
+
 
 
 namespace internal
 {
 
-void AssertRangeCorrect(
-    std::size_t pos, std::size_t bufSize, std::size_t contentLength);
+void AssertRangeCorrect(
+    std::size_t pos, std::size_t bufSize, std::size_t contentLength);
+//Half of chunks fitting into cache: maxChunks or budget if maxChunks is 0.
+//Unlimited if neither limits cache
+std::size_t CalcMaxReadAhead(std::size_t maxChunks,
+                             std::size_t chunkSize,
+                             const MemoryBudget *budget) noexcept;
+
+std::string_view ExtractAddress(std::string_view url);
+std::string_view ExtractPathAndQuery(std::string_view url);
+
+//Requests adjacent to each other, sorted by position
+struct RequestGroup
+{
+    std::size_t pos;
+    std::size_t size;
+    std::vector<ReadRequest> requests;
+};
+
+//Empty requests are skipped, overlapping ones are grouped too
+std::vector<RequestGroup> GroupAdjacent(std::span<const ReadRequest> requests);
+//Copies part of data overlapping every request, data starts at pos
+void CopyOverlap(std::size_t pos,
+                 std::span<const std::byte> data,
+                 std::span<const ReadRequest> requests) noexcept;
+
+//Returns boundary if content type is "multipart/byteranges"
+std::optional<std::string> ExtractByteRangesBoundary(std::string_view contentType);
+//Returns first and last byte positions of "bytes first-last/length" value
+std::pair<std::size_t, std::size_t> ParseContentRange(std::string_view value);
+//Returns length of "bytes first-last/length" value, nullopt if it's unknown
+//("*")
+std::optional<std::size_t> ParseContentRangeLength(std::string_view value);
+
+//Parser of multipart/byteranges body fed by portions as it arrives. Data of
+//parts are passed to sink directly, only delimiters and headers of parts
+//are buffered
+class ByteRangesParser final
+{
+public:
+    //Receives position of data within content
+    using Sink = std::function<void(std::size_t pos, std::span<const std::byte> data)>;
+
+    static constexpr std::size_t cMaxHeadersSize = 1 << 14;
+
+    ByteRangesParser(std::string_view boundary, Sink sink);
+
+    //Throws Error if body is malformed, everything after closing delimiter
+    //is ignored
+    void Feed(std::string_view data);
+    //Throws Error if closing delimiter isn't received
+    void Finish() const;
+
+private:
+    enum class State
+    {
+        Delimiter,
+        Headers,
+        Data,
+        Complete
+    };
+
+    std::string mDelimiter;
+    Sink mSink;
+    State mState{State::Delimiter};
+    //Text which isn't parsed yet
+    std::string mText;
+    //Position and length of the rest of data of current part
+    std::size_t mPos{0};
+    std::size_t mRemaining{0};
+
+    //Parses text until data of part or end of text is reached
+    void ParseText();
+    //Return false if more text is needed
+    bool ParseDelimiter();
+    bool ParseHeaders();
+};
+
+
+
+//Pool of keep-alive connections to single host. Connections are established
+//lazily, if all of them are busy and limit is reached, caller waits until
+//some connection is released
+class ClientPool final
+{
+public:
+    //Returns client into pool on destruction
+    class Lease final
+    {
+    public:
+        Lease(ClientPool &pool, std::unique_ptr<httplib::Client> client);
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        Lease(Lease &&) = default;
+        Lease &operator=(Lease &&) = delete;
+        ~Lease();
+
+        httplib::Client *operator->() const noexcept;
+        httplib::Client &operator*() const noexcept;
+
+    private:
+        std::reference_wrapper<ClientPool> mPool;
+        std::unique_ptr<httplib::Client> mClient;
+    };
+
+    //Initial client (if any) is put into pool as idle one, it's expected to
+    //be connected to the same address already
+    ClientPool(std::string address,
+               std::size_t maxClients,
+               std::unique_ptr<httplib::Client> initial = nullptr);
+    ClientPool(const ClientPool &) = delete;
+    ClientPool &operator=(const ClientPool &) = delete;
+    ClientPool(ClientPool &&) = delete;
+    ClientPool &operator=(ClientPool &&) = delete;
+
+    const std::string &Address() const noexcept;
+    std::size_t MaxClients() const noexcept;
+    //Returns true if client can't be acquired without waiting
+    bool IsExhausted() const;
+    //Throws HttplibError with Canceled code if stop is requested while
+    //waiting
+    Lease Acquire(std::stop_token stop = {});
+
+    static std::unique_ptr<httplib::Client> MakeClient(const std::string &address);
+
+private:
+    const std::string mAddress;
+    const std::size_t mMaxClients;
+    std::size_t mNumClients{0};
+    std::vector<std::unique_ptr<httplib::Client>> mIdle;
+    mutable std::mutex mMtx;
+    std::condition_variable_any mCv;
+
+    void Release(std::unique_ptr<httplib::Client> client) noexcept;
+};
+
+
+
+//Keeps durations of recent requests, e.g. to choose when request is late
+class LatencyTracker final
+{
+public:
+    using Duration = std::chrono::steady_clock::duration;
+
+    static constexpr std::size_t cMinSamples = 16;
+
+    explicit LatencyTracker(std::size_t capacity = 128);
+    LatencyTracker(const LatencyTracker &) = delete;
+    LatencyTracker &operator=(const LatencyTracker &) = delete;
+
+    //Oldest sample is replaced when capacity is reached
+    void Add(Duration latency);
+    //Fraction must be in [0, 1], returns nullopt until there are enough
+    //samples for estimation
+    std::optional<Duration> Percentile(double fraction) const;
+
+private:
+    std::vector<Duration> mSamples;
+    std::size_t mNext{0};
+    mutable std::mutex mMtx;
+};
+
+
+
+//Duplicates transfers which don't make progress for their delay, hedge runs
+//on worker thread while transfer itself continues. Single thread waits for
+//deadlines and up to maxHedges workers run hedges, threads are started on
+//demand and kept. Transfer isn't hedged while pool is exhausted, because
+//hedge would just wait for connection
+class Hedger final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    //Owned by caller, it must be unwatched before destruction
+    struct Transfer
+    {
+        //Exceptions are ignored, so hedge must handle them itself
+        std::function<void(std::stop_token)> hedge;
+        Clock::duration delay{};
+        //Updated by caller (clock ticks)
+        std::atomic<Clock::rep> lastProgress{0};
+        //Hedge gets token of this source
+        std::stop_source stop;
+    };
+
+    Hedger(std::shared_ptr<ClientPool> pool, std::size_t maxHedges);
+    Hedger(const Hedger &) = delete;
+    Hedger &operator=(const Hedger &) = delete;
+    Hedger(Hedger &&) = delete;
+    Hedger &operator=(Hedger &&) = delete;
+    ~Hedger() = default;
+
+    void Watch(Transfer &transfer);
+    //Transfer isn't hedged after return, running hedge is waited for, so it
+    //should be requested to stop first unless its result is needed
+    void Unwatch(Transfer &transfer) noexcept;
+
+private:
+    struct Watched
+    {
+        Transfer *transfer;
+        //Hedge postponed because pool was exhausted
+        Clock::time_point retryTime;
+    };
+
+    const std::shared_ptr<ClientPool> mPool;
+    const std::size_t mMaxHedges;
+    std::vector<Watched> mWatched;
+    //Capacity of both is reserved, so hedges are started without allocation
+    std::vector<Transfer *> mQueued;
+    std::vector<Transfer *> mRunning;
+    bool mIsChanged{false};
+    std::mutex mMtx;
+    std::condition_variable_any mCv;
+    std::vector<std::jthread> mWorkers;
+    //Declared last to be stopped before workers, which it starts
+    std::jthread mWatcher;
+
+    void WatchLoop(std::stop_token stop);
+    void RunLoop(std::stop_token stop);
+};
+
+
+
+//Owner of native file handle, reads are positional (pread/ReadFile with
+//offset), so no shared file position exists and they may happen concurrently
+class FileHandle final
+{
+public:
+#if defined(VDOWNLOADER_OS_WINDOWS)
+    using Native = void *;
+#else
+    using Native = int;
+#endif
+
+    explicit FileHandle(const std::filesystem::path &path);
+    FileHandle(const FileHandle &) = delete;
+    FileHandle &operator=(const FileHandle &) = delete;
+    FileHandle(FileHandle &&other) noexcept;
+    FileHandle &operator=(FileHandle &&other) noexcept;
+    ~FileHandle();
+
+    //Creates file in system temporary directory opened for reading and
+    //writing, it's removed when handle is closed
+    static FileHandle CreateTemporary();
+
+    std::size_t Size() const;
+    //Reads exactly buf.size_bytes() bytes, throws if file is shorter
+    void ReadAt(std::size_t pos, std::span<std::byte> buf) const;
+    //Writes whole buffer, file is extended if needed
+    void WriteAt(std::size_t pos, std::span<const std::byte> buf) const;
+    Native NativeHandle() const noexcept;
+
+private:
+    Native mHandle;
+
+    explicit FileHandle(Native handle) noexcept;
+
+    static Native InvalidHandle() noexcept;
+    void Close() noexcept;
+};
+
+
+
+//Read-only mapping of whole file into memory, unmapped on destruction
+class FileMapping final
+{
+public:
+    explicit FileMapping(const std::filesystem::path &path);
+    FileMapping(const FileMapping &) = delete;
+    FileMapping &operator=(const FileMapping &) = delete;
+    FileMapping(FileMapping &&) = delete;
+    FileMapping &operator=(FileMapping &&) = delete;
+    ~FileMapping();
+
+    std::span<const std::byte> Data() const noexcept;
+
+private:
+    const std::byte *mData{nullptr};
+    std::size_t mSize{0};
+};
+
+
+
+//Buffer of known size filled sequentially by single writer while readers
+//wait for ranges they need. First memoryLimit bytes are kept in memory, the
+//rest is spilled into temporary file. Arrived data are never modified, so
+//readers copy them without holding any lock
+class ProgressiveBuffer final
+{
+public:
+    //Memory part is reduced to fit into budget if it's given
+    ProgressiveBuffer(std::size_t size,
+                      std::size_t memoryLimit,
+                      const std::shared_ptr<MemoryBudget> &budget = nullptr);
+    ProgressiveBuffer(const ProgressiveBuffer &) = delete;
+    ProgressiveBuffer &operator=(const ProgressiveBuffer &) = delete;
+    ProgressiveBuffer(ProgressiveBuffer &&) = delete;
+    ProgressiveBuffer &operator=(ProgressiveBuffer &&) = delete;
+
+    std::size_t Size() const noexcept;
+    std::size_t NumAvailable() const;
+    bool Failed() const;
+
+    //Must be invoked by writer only, throws if data don't fit into buffer
+    void Append(std::span<const std::byte> data);
+    //Readers waiting for data which will never arrive get this error
+    void Fail(std::exception_ptr error) noexcept;
+    //Blocks until requested range arrives or buffer fails
+    void Read(std::size_t pos, std::span<std::byte> buf) const;
+
+private:
+    const std::size_t mSize;
+    MemoryBudget::Reservation mReservation;
+    const std::size_t mMemorySize;
+    std::unique_ptr<std::byte[]> mMemory;
+    std::optional<FileHandle> mFile;
+
+    std::size_t mAvailable{0};
+    std::exception_ptr mError;
+    mutable std::mutex mMtx;
+    mutable std::condition_variable mCv;
+};
+
+
+
+//Orders fetches by priority. Up to maxActive fetches run at once (unlimited
+//if 0), waiting fetch starts only when no more urgent one waits. Speculative
+//fetch doesn't take the last free slot while more urgent ones are active, so
+//it uses only capacity left idle and blocked reader never waits for it
+class FetchScheduler final
+{
+public:
+    //Fetch is finished on destruction
+    class Permit final
+    {
+    public:
+        Permit() = default;
+        Permit(const Permit &) = delete;
+        Permit &operator=(const Permit &) = delete;
+        Permit(Permit &&other) noexcept;
+        Permit &operator=(Permit &&other) noexcept;
+        ~Permit();
+
+        explicit operator bool() const noexcept;
+
+    private:
+        friend class FetchScheduler;
+
+        FetchScheduler *mScheduler{nullptr};
+        FetchPriority mPriority{FetchPriority::Demand};
+
+        Permit(FetchScheduler &scheduler, FetchPriority priority) noexcept;
+        void Release() noexcept;
+    };
+
+    explicit FetchScheduler(std::size_t maxActive);
+    FetchScheduler(const FetchScheduler &) = delete;
+    FetchScheduler &operator=(const FetchScheduler &) = delete;
+
+    //Waits until fetch may start
+    Permit Acquire(FetchPriority priority);
+    //Returns nullopt instead of waiting
+    std::optional<Permit> TryAcquire(FetchPriority priority);
+    std::size_t NumWaiting(FetchPriority priority) const;
+
+private:
+    static constexpr std::size_t cNumPriorities = 3;
+
+    const std::size_t mMaxActive;
+    std::array<std::size_t, cNumPriorities> mNumActive{};
+    std::array<std::size_t, cNumPriorities> mNumWaiting{};
+    mutable std::mutex mMtx;
+    std::condition_variable mCv;
+
+    //Must be called with lock held
+    bool CanStart(FetchPriority priority) const noexcept;
+};
+
+//Persistent storage of blocks of resources shared by program runs. Every
+//resource has its own subdirectory named by hash of its key, blocks are
+//files named by their index. Least recently used blocks (according to
+//modification time) of all resources are removed when total size exceeds
+//limit. Caching is optimization only, so filesystem errors aren't reported
+//and just make blocks to be missing. If directory can't be prepared, cache
+//stays empty and nothing is stored
+class DiskCache final
+{
+public:
+    DiskCache(const std::filesystem::path &dir, const std::string &key, std::size_t maxSize);
+    DiskCache(const DiskCache &) = delete;
+    DiskCache &operator=(const DiskCache &) = delete;
+    DiskCache(DiskCache &&) = delete;
+    DiskCache &operator=(DiskCache &&) = delete;
+
+    std::size_t TotalSize() const;
+    //False if directory couldn't be prepared
+    bool IsAvailable() const noexcept;
+    //Returns false if block isn't cached or its size isn't equal to buffer size
+    bool Load(std::size_t id, std::span<std::byte> buf);
+    //Reads part of block starting at offset, returns false if block isn't
+    //cached or its size isn't equal to blockSize
+    bool Load(std::size_t id, std::size_t blockSize, std::size_t offset, std::span<std::byte> buf);
+    void Store(std::size_t id, std::span<const std::byte> data) noexcept;
+    //Directory of cached content. Other files placed there count against
+    //size limit from next scan, directory of content other than current one
+    //is removed together with them once its last block is evicted
+    const std::filesystem::path &Dir() const noexcept;
+
+    static std::string HashKey(std::string_view key);
+
+private:
+    struct Block
+    {
+        std::filesystem::path path;
+        std::size_t size;
+    };
+
+    struct Content
+    {
+        std::size_t numBlocks;
+        //Size of files other than blocks and key
+        std::size_t sidecarsSize;
+    };
+
+    using Blocks = std::list<Block>;
+    using Index = std::unordered_map<std::string, Blocks::iterator>;
+    //Directories of content by path
+    using Contents = std::unordered_map<std::string, Content>;
+
+    const std::filesystem::path mDir;
+    const std::size_t mMaxSize;
+    bool mIsAvailable{true};
+    std::size_t mTotalSize{0};
+    //Ordered from least to most recently used
+    Blocks mBlocks;
+    Index mIndex;
+    Contents mContents;
+    //Used to make unique names of files being written
+    std::size_t mNumStored{0};
+    mutable std::mutex mMtx;
+
+    //Only directories containing key file are considered to be cache
+    //content, anything else is left untouched. Content directories without
+    //blocks are removed, unless it's the current one
+    void Scan(const std::filesystem::path &root);
+    //Must be called with lock held, file of block is removed too and so is
+    //directory of content other than current one if it was the last block
+    void Remove(Blocks::iterator block) noexcept;
+    //Must be called with lock held
+    void Shrink() noexcept;
+};
+
+} //namespace internal
+
+//Class to access web resource by HTTP(S) protocol. Establish keep-alive connection on creation.
+//Range requests are issued through pool of up to maxConnections keep-alive
+//connections, so concurrent reads don't wait for each other unless pool is
+//exhausted. If server doesn't support range requests (or range unit isn't
+//byte), content is downloaded in background starting from first Read
+//invocation, and reads wait only until their range arrives. Content beyond
+//memoryLimit bytes is kept in temporary file. If budget is given, download
+//takes not more than half of it, so there is room left for caches above.
+//Vectored reads merge adjacent ranges into single request, other ranges are
+//requested together if server responds with multipart/byteranges (once it
+//doesn't, ranges are requested one by one for cMultipartRetryDelay). Parts
+//are written to requests as they arrive, body isn't buffered.
+//Connection is established by ranged GET of first initialSize bytes, which
+//are kept and lent by View, so cache above gets them without another round
+//trip. HEAD is issued only if server doesn't respond with partial content.
+class HttpSource final
+{
+public:
+    static constexpr bool cConcurrentReads = true;
+    static constexpr std::size_t cDefaultMemoryLimit = std::size_t{1} << 28;
+    static constexpr std::size_t cMaxRangesPerRequest = 16;
+    static constexpr std::size_t cDefaultInitialSize = std::size_t{1} << 20;
+    //Range request which doesn't make progress for longer than this
+    //percentile of times to first byte is duplicated on another connection,
+    //up to maxConnections - 1 requests are hedged at once
+    static constexpr double cHedgePercentile = 0.95;
+    static constexpr std::chrono::milliseconds cMinHedgeDelay{20};
+    //Interrupted range request is resumed from first missing byte, attempts
+    //are limited only when no bytes were received
+    static constexpr std::size_t cMaxFailedResumes = 3;
+    static constexpr std::chrono::seconds cMultipartRetryDelay{30};
+
+    explicit HttpSource(const std::string &url,
+                        std::size_t maxConnections = 1,
+                        std::size_t memoryLimit = cDefaultMemoryLimit,
+                        std::shared_ptr<MemoryBudget> budget = nullptr,
+                        std::size_t initialSize = cDefaultInitialSize);
+    HttpSource(const HttpSource &) = delete;
+    HttpSource &operator=(const HttpSource &) = delete;
+    HttpSource(HttpSource &&) = default;
+    HttpSource &operator=(HttpSource &&) = default;
+
+    std::size_t GetContentLength() const noexcept;
+    //Consists of url and validators (ETag, Last-Modified, Content-Length)
+    //reported by server
+    const std::string &GetCacheKey() const noexcept;
+    //One range request per connection, reads of background download aren't
+    //limited
+    std::size_t GetMaxConcurrentReads() const noexcept;
+    //Reading zero bytes performs no operation and returns immediately
+    void Read(std::size_t pos, std::span<std::byte> buf);
+    void ReadV(std::span<const ReadRequest> requests);
+    //Only ranges within initially received bytes can be lent
+    std::optional<SourceView> View(std::size_t pos, std::size_t len);
+
+private:
+    using Sink = std::function<void(std::span<const std::byte>)>;
+
+    //Beginning of content received on connection
+    struct Initial
+    {
+        std::vector<std::byte> data;
+        MemoryBudget::Reservation reservation;
+    };
+
+    struct Download
+    {
+        Download(std::size_t size,
+                 std::size_t memoryLimit,
+                 const std::shared_ptr<MemoryBudget> &budget);
+
+        internal::ProgressiveBuffer buffer;
+        //Declared last to be stopped and joined before buffer is destroyed
+        std::jthread thread;
+    };
+
+    //Pool is created by EstablishConnection when final address is known
+    //(after redirections), it's shared with background download
+    std::shared_ptr<internal::ClientPool> mPool;
+    std::string mRequestStr; 
+    std::shared_ptr<Download> mDownload;
+    std::unique_ptr<std::mutex> mDownloadMtx;
+    std::size_t mMemoryLimit;
+    std::shared_ptr<MemoryBudget> mBudget;
+    std::string mCacheKey;
+    std::size_t mContentLength;
+    bool mIsRangeSupported;
+    //Multipart requests aren't issued before this time (steady clock ticks)
+    std::unique_ptr<std::atomic<std::chrono::steady_clock::rep>> mMultipartRetryTime;
+    std::unique_ptr<internal::LatencyTracker> mLatency;
+    //Exists only if ranges are supported and pool has spare connections
+    std::unique_ptr<internal::Hedger> mHedger;
+    std::shared_ptr<const Initial> mInitial;
+
+    httplib::Headers EstablishConnection(std::string url, std::size_t maxConnections);
+    //Returns headers of partial content response, nullopt if server responded
+    //otherwise
+    std::optional<httplib::Headers> ReceiveInitial(const std::string &url,
+                                                   std::size_t maxConnections,
+                                                   std::size_t size);
+    //Returns false if range isn't received on connection
+    bool ReadInitial(std::size_t pos, std::span<std::byte> buf) const noexcept;
+    //Returns running or completed download, failed one is restarted
+    std::shared_ptr<Download> GetDownload();
+    //Every byte of range is passed to sink exactly once and in order, though
+    //it may be received by hedged or resumed request
+    void ReceiveRange(std::size_t pos, std::size_t size, const Sink &sink);
+    std::optional<internal::LatencyTracker::Duration> GetHedgeDeadline() const;
+    void ReceiveGroup(const internal::RequestGroup &group);
+    //Returns false if response isn't multipart/byteranges one, nothing is
+    //written then
+    bool ReceiveMultipart(std::span<const internal::RequestGroup> groups);
+    //Response body must be exactly size bytes long, it's passed to sink by
+    //portions as it arrives. Exception thrown by sink cancels receiving and
+    //is rethrown, the same happens when stop is requested
+    static void ReceiveBody(internal::ClientPool &pool,
+                            const std::string &requestStr,
+                            const httplib::Headers &headers,
+                            httplib::StatusCode expectedCode,
+                            std::size_t size,
+                            const Sink &sink,
+                            std::stop_token stop = {});
+    //Returns reference to result member
+    const httplib::Response &AssertRequestSuccessful(
+        const httplib::Result& result,
+        httplib::StatusCode expectedCode = httplib::StatusCode::OK_200) const;
+    static void AssertResponseLengthCorrect(std::size_t requested, std::size_t actual);
+};
+
+static_assert(std::is_nothrow_move_assignable_v<HttpSource>);
+static_assert(std::is_nothrow_move_constructible_v<HttpSource>);
+
+
+
+//Viewed memory isn't owned, so it must outlive source and all lent views
+class MemoryViewSource final
+{
+public:
+    static constexpr bool cConcurrentReads = true;
+
+    explicit MemoryViewSource(std::span<const std::byte> buf = {});
+
+    std::size_t GetContentLength() const noexcept;
+    void Read(std::size_t pos, std::span<std::byte> buf);
+    std::optional<SourceView> View(std::size_t pos, std::size_t len);
+
+private:
+    std::span<const std::byte> mBuf;
+};
+
+
+
+//File size is cached in constructor, so file is not supposed to be modified
+//while source exists. Reads are positional and don't share any state,
+//therefore they may be issued from multiple threads simultaneously
+class FileSource final
+{
+public:
+    static constexpr bool cConcurrentReads = true;
+
+    explicit FileSource(const std::filesystem::path &path);
+
+    FileSource(const FileSource &) = delete;
+    FileSource &operator=(const FileSource &) = delete;
+    FileSource(FileSource &&) = default;
+    FileSource &operator=(FileSource &&) = default;
+
+    std::size_t GetContentLength() const noexcept;
+    void Read(std::size_t pos, std::span<std::byte> buf);
+
+private:
+    internal::FileHandle mFile;
+    std::size_t mSize;
+};
+
+
+
+//Whole file is mapped into memory in constructor, reads are plain copies
+//from mapping and views are always lent directly from it, so there are no
+//intermediate buffers at all. Mapping is shared with lent views and lives
+//until source and all its views are destroyed
+class MappedFileSource final
+{
+public:
+    static constexpr bool cConcurrentReads = true;
+
+    explicit MappedFileSource(const std::filesystem::path &path);
+
+    MappedFileSource(const MappedFileSource &) = delete;
+    MappedFileSource &operator=(const MappedFileSource &) = delete;
+    MappedFileSource(MappedFileSource &&) = default;
+    MappedFileSource &operator=(MappedFileSource &&) = default;
+
+    std::size_t GetContentLength() const noexcept;
+    void Read(std::size_t pos, std::span<std::byte> buf);
+    std::optional<SourceView> View(std::size_t pos, std::size_t len);
+
+private:
+    std::shared_ptr<const internal::FileMapping> mMapping;
+};
+
+
+
+//Policy choosing chunks to discard from CachedSource. Insert is called for
+//new chunks, Touch for accessed ones and Erase for chunks taken out of
+//policy control, only tracked chunks are passed to Touch and Erase. Evict
+//stops tracking of chosen chunk and returns it, nullopt means nothing is
+//tracked
+template <class T>
+concept EvictionPolicyConcept =
+    std::is_default_constructible_v<T> &&
+    std::is_move_constructible_v<T> &&
+    requires(T v, const T cv, std::size_t id)
+    {
+        { v.Insert(id) } -> std::same_as<void>;
+        { v.Touch(id) } -> std::same_as<void>;
+        { v.Erase(id) } -> std::same_as<void>;
+        { v.Evict() } -> std::same_as<std::optional<std::size_t>>;
+        { cv.Size() } -> std::same_as<std::size_t>;
+    };
+
+//Least recently used chunk is evicted first
+class LruPolicy final
+{
+public:
+    void Insert(std::size_t id);
+    void Touch(std::size_t id) noexcept;
+    void Erase(std::size_t id) noexcept;
+    std::optional<std::size_t> Evict() noexcept;
+    std::size_t Size() const noexcept;
+
+private:
+    using Order = std::list<std::size_t>;
+
+    //Ordered from least to most recently used
+    Order mOrder;
+    std::unordered_map<std::size_t, Order::iterator> mIndex;
+};
+
+//CLOCK: chunks are kept in flat open addressing table swept by clock hand,
+//accessed chunks get reference bit and survive one more sweep. Touch only
+//sets bit and nothing is allocated per chunk, table grows when it's filled
+class ClockPolicy final
+{
+public:
+    ClockPolicy() = default;
+    //Table is preallocated for given number of chunks
+    explicit ClockPolicy(std::size_t capacity);
+
+    void Insert(std::size_t id);
+    void Touch(std::size_t id) noexcept;
+    void Erase(std::size_t id) noexcept;
+    std::optional<std::size_t> Evict() noexcept;
+    std::size_t Size() const noexcept;
+
+private:
+    enum class SlotState : std::uint8_t
+    {
+        Empty,
+        Used,
+        //Keeps probe sequences of other slots unbroken
+        Erased
+    };
+
+    struct Slot
+    {
+        std::size_t id{0};
+        SlotState state{SlotState::Empty};
+        bool isReferenced{false};
+    };
+
+    static constexpr std::size_t cMinCapacity = 16;
+
+    //Capacity is power of 2, at most 3/4 of slots are used or erased
+    std::vector<Slot> mSlots;
+    std::size_t mSize{0};
+    std::size_t mNumErased{0};
+    std::size_t mHand{0};
+
+    std::size_t Find(std::size_t id) const noexcept;
+    void Rehash(std::size_t capacity);
+};
+
+//Simplified 2Q: new chunks get into FIFO queue and are evicted from it
+//unless they are accessed again after eviction (it's recognized by history
+//of recently evicted ids), then they get into main queue. Repeated accesses
+//while in FIFO queue are usually made by single reader, so they don't count.
+//Therefore long sequential scans evict each other rather than chunks used
+//by multiple readers. Main queue is evicted first only when FIFO queue is
+//small enough, it's CLOCK, so hits of reused chunks only set reference bits
+class TwoQueuePolicy final
+{
+public:
+    //FIFO queue is evicted first when it's larger than 1/cInShare of all
+    static constexpr std::size_t cInShare = 4;
+    static constexpr std::size_t cMinHistory = 16;
+
+    void Insert(std::size_t id);
+    void Touch(std::size_t id) noexcept;
+    void Erase(std::size_t id) noexcept;
+    std::optional<std::size_t> Evict() noexcept;
+    std::size_t Size() const noexcept;
+
+private:
+    using Queue = std::list<std::size_t>;
+    using QueueIndex = std::unordered_map<std::size_t, Queue::iterator>;
+
+    Queue mIn;
+    QueueIndex mInIndex;
+    ClockPolicy mMain;
+    //Ids evicted from FIFO queue, oldest first
+    Queue mHistory;
+    QueueIndex mHistoryIndex;
+
+    void Remember(std::size_t id);
+    void Forget(QueueIndex::iterator it) noexcept;
+};
+
+
+
+//Wrapper keeping content of source on disk between program runs, it's meant
+//to be placed under CachedSource with the same block and chunk sizes, so
+//every chunk corresponds to single block. Blocks are stored when they're
+//read as whole, reads of their parts (e.g. sector fills of cache above) are
+//served from stored blocks or forwarded to source as they are, so parts of
+//blocks are never fetched whole. Concurrent reads are supported if source
+//supports them.
+template <KeyedSourceConcept SourceT>
+class DiskCachedSource final
+{
+public:
+    static constexpr bool cConcurrentReads = ConcurrentSourceConcept<SourceT>;
+    static const std::size_t cDefaultBlockSize = 1 << 19;
+
+    DiskCachedSource(SourceT source,
+                     const std::filesystem::path &dir,
+                     std::size_t maxSize,
+                     std::size_t blockSize = cDefaultBlockSize);
+
+    std::size_t GetContentLength() const;
+    std::string GetCacheKey() const;
+    //Limit of source, though disk hits don't count against it
+    std::size_t GetMaxConcurrentReads() const;
+    //False if cache directory isn't usable, every read goes to source then
+    bool IsPersistent() const noexcept;
+    //File kept next to cached blocks, it counts against size limit and is
+    //removed once content changes and its blocks are evicted. Name mustn't
+    //be a number, "key" or end with ".tmp". Empty if cache isn't persistent
+    std::filesystem::path GetSidecarPath(std::string_view name) const;
+    void Read(std::size_t pos, std::span<std::byte> buf);
+    //Misses of requests covering whole blocks are forwarded to source
+    //together, other requests are read one by one
+    void ReadV(std::span<const ReadRequest> requests);
+
+private:
+    SourceT mSrc;
+    std::unique_ptr<internal::DiskCache> mCache;
+    std::size_t mBlockSize;
+};
+
+template <KeyedSourceConcept SourceT>
+DiskCachedSource<SourceT>::DiskCachedSource(SourceT source,
+                                            const std::filesystem::path &dir,
+                                            std::size_t maxSize,
+                                            std::size_t blockSize)
+    : mSrc{std::move(source)},
+      mBlockSize{blockSize}
+{
+    if(mBlockSize < 1)
+    {
+        throw ArgumentError{"block size must be greater than 0"};
+    }
+
+    //Block size is part of key, because blocks of different size can't be mixed
+    mCache = std::make_unique<internal::DiskCache>(
+        dir, std::format("{}\nBlock-Size: {}", GetCacheKey(), mBlockSize), maxSize);
+}
+
+template <KeyedSourceConcept SourceT>
+std::size_t DiskCachedSource<SourceT>::GetContentLength() const
+{
+    return mSrc.GetContentLength();
+}
+
+template <KeyedSourceConcept SourceT>
+std::string DiskCachedSource<SourceT>::GetCacheKey() const
+{
+    return mSrc.GetCacheKey();
+}
+
+template <KeyedSourceConcept SourceT>
+std::size_t DiskCachedSource<SourceT>::GetMaxConcurrentReads() const
+{
+    return vd::GetMaxConcurrentReads(mSrc);
+}
+
+template <KeyedSourceConcept SourceT>
+bool DiskCachedSource<SourceT>::IsPersistent() const noexcept
+{
+    return mCache->IsAvailable();
+}
+
+template <KeyedSourceConcept SourceT>
+std::filesystem::path DiskCachedSource<SourceT>::GetSidecarPath(std::string_view name) const
+{
+    return mCache->IsAvailable() ? mCache->Dir() / name : std::filesystem::path{};
+}
+
+template <KeyedSourceConcept SourceT>
+void DiskCachedSource<SourceT>::Read(std::size_t pos, std::span<std::byte> buf)
+{
+    if(buf.size_bytes() == 0)
+    {
+        return;
+    }
+
+    auto contentLength = GetContentLength();
+    internal::AssertRangeCorrect(pos, buf.size_bytes(), contentLength);
+
+    while(!buf.empty())
+    {
+        auto id = pos / mBlockSize;
+        auto blockPos = id * mBlockSize;
+        auto blockLen = std::min(mBlockSize, contentLength - blockPos);
+        auto offset = pos - blockPos;
+        auto len = std::min(buf.size_bytes(), blockLen - offset);
+
+        auto dest = buf.first(len);
+        if(len == blockLen)
+        {
+            if(!mCache->Load(id, dest))
+            {
+                mSrc.Read(blockPos, dest);
+                mCache->Store(id, dest);
+            }
+        }
+        else if(!mCache->Load(id, blockLen, offset, dest))
+        {
+            mSrc.Read(pos, dest);
+        }
+
+        pos += len;
+        buf = buf.subspan(len);
+    }
+}
+
+template <KeyedSourceConcept SourceT>
+void DiskCachedSource<SourceT>::ReadV(std::span<const ReadRequest> requests)
+{
+    auto contentLength = GetContentLength();
+    auto misses = std::vector<ReadRequest>{};
+
+    for(const auto &request : requests)
+    {
+        internal::AssertRangeCorrect(request.pos, request.buf.size_bytes(), contentLength);
+
+        auto id = request.pos / mBlockSize;
+        auto blockPos = id * mBlockSize;
+        auto blockLen = std::min(mBlockSize, contentLength - blockPos);
+        if(request.buf.empty() || request.pos != blockPos || request.buf.size_bytes() != blockLen)
+        {
+            Read(request.pos, request.buf);
+        }
+        else if(!mCache->Load(id, request.buf))
+        {
+            misses.push_back(request);
+        }
+    }
+
+    vd::ReadV(mSrc, misses);
+
+    for(const auto &miss : misses)
+    {
+        mCache->Store(miss.pos / mBlockSize, miss.buf);
+    }
+}
+
+
+
+struct CacheStats final
+{
+    //Bytes read from underlying source
+    std::size_t fetchedBytes{0};
+    //Bytes read or viewed by users of cache
+    std::size_t consumedBytes{0};
+};
+
+//Wrapper for buffering read operations on sources.
+//It is thread safe natively also. Every chunk is fetched only once at a time,
+//threads requesting chunk which is being fetched wait for that fetch to
+//complete. Fetches of different chunks are serialized only for sources not
+//satisfying ConcurrentSourceConcept. Chunks of sources satisfying
+//ViewableSourceConcept are views lent by source, so no copying happens.
+//MaxChunks parameter sets maximum amount of cached chunks (unlimited if 0).
+//ReadAhead parameter sets number of chunks fetched in background when
+//sequential access is detected (disabled if 0), it's limited to half of
+//maxChunks (or half of chunks fitting into budget if maxChunks is 0) to keep
+//room for chunks being consumed.
+//Budget (if given) limits total size of chunks in bytes, memory of
+//chunks lent by viewable sources isn't accounted. Oldest chunks are
+//discarded when budget is exhausted, if nothing is left to discard budget
+//is exceeded, because chunk is needed anyway.
+//PolicyT chooses chunks to discard. Pinned ranges are never discarded and
+//don't count against maxChunks (they still consume budget), pinning isn't
+//counted, so single Unpin releases range pinned several times.
+//SectorSize parameter (equal to chunkSize if 0) sets granularity of fills:
+//chunks are filled on demand sector by sector, so small reads don't fetch
+//whole chunks. Fills grow with every further read of the chunk, and they
+//cover the rest of chunk once sequential access is detected.
+//Chunk buffers are taken from arena (own one is created if not given), its
+//block size must be chunkSize at least.
+//Index is flat and split into shards, so cache hits lock only shard of
+//chunk and don't serialize on single mutex, nothing is allocated per chunk
+//besides its buffer. Accesses by hits are passed to policy later in
+//batches, sequential access is detected without locks.
+//Fetches are ordered by FetchScheduler: reads are demand fetches, read-ahead
+//is speculative. Fetches of non-concurrent sources run one at a time, those
+//of limited concurrency ones are bounded by their limit.
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT = LruPolicy>
+class CachedSource final
+{
+public:
+    static const std::size_t cDefaultChunkSize = 1 << 19;
+
+    explicit CachedSource(SourceT source,
+                          std::size_t maxChunks = 1,
+                          std::size_t chunkSize = cDefaultChunkSize,
+                          std::size_t readAhead = 0,
+                          std::shared_ptr<MemoryBudget> budget = nullptr,
+                          std::size_t sectorSize = 0,
+                          std::shared_ptr<ChunkArena> arena = nullptr);
+    CachedSource(const CachedSource &) = delete;
+    CachedSource &operator=(const CachedSource &) = delete;
+    //Background fetching of moved source is stopped (current fetch is
+    //finished first) and restarted on demand by new one
+    CachedSource(CachedSource &&other);
+    CachedSource &operator=(CachedSource &&) = delete;
+    ~CachedSource() = default;
+
+    std::size_t NumCachedChunks() const;
+    CacheStats GetStats() const;
+    //Content length is taken from source only once
+    std::size_t GetContentLength() const;
+    //Reading zero bytes performs no operation and returns immediately
+    void Read(std::size_t pos, std::span<std::byte> buf);
+    //Range must fit into single chunk, which is kept alive by returned view,
+    //or else it may be lent only directly by viewable source
+    std::optional<SourceView> View(std::size_t pos, std::size_t len);
+    //Chunks covering range are fetched into cache with given priority,
+    //nothing is copied
+    void Prefetch(std::size_t pos,
+                  std::size_t len,
+                  FetchPriority priority = FetchPriority::Metadata);
+    //Chunks covering range are kept until unpinned, they are fetched on
+    //demand as usual
+    void Pin(std::size_t pos, std::size_t len);
+    void Unpin(std::size_t pos, std::size_t len);
+
+private:
+    //Owner of chunk is either buffer allocated by us or something provided
+    //by viewable source
+    using Chunk = SourceView;
+
+    //Chunks lent by viewable sources are always complete
+    struct Entry
+    {
+        Chunk chunk;
+        //Destination of fills, it's empty for lent chunks
+        std::span<std::byte> buffer;
+    };
+
+    //Sectors of chunk filled by single fetch, entry is allocated by fetch
+    //if chunk isn't cached yet
+    struct Fill
+    {
+        std::size_t id;
+        std::optional<Entry> entry;
+        std::vector<bool> sectors;
+        //Valid sectors of discarded chunk are kept in case its entry is
+        //filled again, but they don't belong to new entry
+        bool isAllocated{false};
+    };
+
+    //Chunks being filled at the moment
+    using Pending = std::unordered_map<std::size_t, std::shared_future<void>>;
+
+    static const std::size_t cNumShards = 16;
+    //Accesses of shard buffered for policy, excess ones are dropped
+    static const std::size_t cMaxBufferedTouches = 64;
+    static constexpr std::size_t cBitsPerWord = std::numeric_limits<std::uint64_t>::digits;
+
+    //Chunk has slot id / cNumShards in its shard and mSectorWords words of
+    //bitmap of valid sectors, both are allocated once content length is
+    //known. Content of shard is changed with both cache and shard locks
+    //held, so either of them is enough to read it
+    struct Shard
+    {
+        std::mutex mtx;
+        std::vector<std::optional<Entry>> entries;
+        std::vector<std::uint64_t> valid;
+        std::size_t numEntries{0};
+        std::array<std::size_t, cMaxBufferedTouches> touches;
+        std::size_t numTouches{0};
+    };
+
+    //Read-ahead is scheduled when sequential stream moves to next chunk
+    enum class Access
+    {
+        Random,
+        Sequential,
+        Advanced
+    };
+
+    static const std::size_t cMaxStreams = 16;
+    static constexpr std::size_t cStreamLengthBits = 8;
+
+    //Stream is sequence of chunks accessed one after another, likely by
+    //single reader. It's packed into single word to be tracked without
+    //locks: id of last chunk is kept above cStreamLengthBits bits of its
+    //length (saturated), zero word is empty slot
+    struct Streams
+    {
+        std::array<std::atomic<std::size_t>, cMaxStreams> slots{};
+        //New streams replace old ones in round robin order
+        std::atomic<std::size_t> next{0};
+    };
+    //Maximum number of chunks requested from source at once by single read
+    static const std::size_t cMaxCoalescedChunks = 16;
+    //Maximum number of buffers kept for reuse by own arena
+    static constexpr std::size_t cMaxFreeBuffers = 4;
+    //Number of chunks accessed in a row to consider access sequential
+    static const std::size_t cSequentialThreshold = 2;
+    
+    SourceT mSrc;
+    //Contains pinned chunks too, but policy tracks only unpinned ones
+    std::unique_ptr<Shard[]> mShards;
+    PolicyT mPolicy;
+    std::unordered_set<std::size_t> mPinned;
+    Pending mPending;
+    mutable std::unique_ptr<internal::FetchScheduler> mScheduler;
+    mutable std::unique_ptr<std::mutex> mCacheMtx;
+    const std::size_t mMaxChunks;
+    const std::size_t mChunkSize;
+    const std::size_t mSectorSize;
+    const std::size_t mSectorWords;
+    const std::size_t mReadAhead;
+    const std::shared_ptr<MemoryBudget> mBudget;
+    const std::shared_ptr<ChunkArena> mArena;
+    //Max value means that it isn't known yet
+    mutable std::unique_ptr<std::atomic<std::size_t>> mContentLength;
+    std::unique_ptr<std::atomic<std::size_t>> mConsumedBytes;
+    //Guarded by cache mutex
+    std::size_t mFetchedBytes{0};
+    bool mIsIndexAllocated{false};
+    std::unique_ptr<Streams> mStreams;
+    //Guarded by cache mutex
+    std::deque<std::size_t> mReadAheadQueue;
+    std::unique_ptr<std::condition_variable_any> mReadAheadCv;
+    //Must be the last member, so it's stopped before anything else destroyed
+    std::jthread mReadAheadThread;
+
+    //Source may be accessed while returned permit is held
+    internal::FetchScheduler::Permit LockSource(FetchPriority priority = FetchPriority::Demand) const;
+    std::size_t GetChunkId(std::size_t pos) const noexcept;
+    std::size_t GetChunkLength(std::size_t id, std::size_t contentLength) const noexcept;
+    //Returns sectors [first, last) covering bytes [from, to) of chunk, at
+    //least one sector is returned if chunk isn't empty
+    std::pair<std::size_t, std::size_t> GetSectorRange(std::size_t from,
+                                                       std::size_t to,
+                                                       std::size_t numSectors) const noexcept;
+    std::size_t GetNumSectors(std::size_t chunkLength) const noexcept;
+    Shard &GetShard(std::size_t id) const noexcept;
+    //Must be called with cache lock held, does nothing if index is allocated
+    //already
+    void AllocateIndex(std::size_t contentLength);
+    //Must be called with cache or shard lock held
+    const Entry *FindEntry(std::size_t id) const noexcept;
+    //Must be called with cache or shard lock held, sectors [first, last) of
+    //chunk are checked
+    bool AreSectorsValid(std::size_t id, std::size_t first, std::size_t last) const noexcept;
+    //Must be called with cache and shard locks held. Stale sectors of
+    //discarded chunk are cleared if fill has allocated new entry
+    void MarkValid(const Fill &fill) noexcept;
+    //Takes only shard lock, returns nullopt if bytes [from, to) of chunk
+    //aren't valid
+    std::optional<Chunk> TryHit(std::size_t id, std::size_t from, std::size_t to);
+    //Must be called with cache lock held
+    std::optional<Chunk> SearchInIndex(std::size_t id);
+    //Must be called with cache lock held, passes buffered accesses to policy
+    void ApplyTouches() noexcept;
+    //Returns chunks covering range, bytes of range are valid in them.
+    //Missing sectors are fetched together, so adjacent ones are read by
+    //single request if source supports vectored reads. In case of exception
+    //oldest chunks may be discarded but fetched sectors won't be marked
+    //valid. Exception is delivered to all waiting threads too
+    std::vector<Chunk> GetChunks(std::size_t pos,
+                                 std::size_t len,
+                                 bool isSequential,
+                                 FetchPriority priority);
+    //Must be called with cache lock held. Bytes [from, to) of chunk are
+    //needed, returns nullopt if they are valid already
+    std::optional<Fill> PlanFill(std::size_t id,
+                                 std::size_t from,
+                                 std::size_t to,
+                                 std::size_t chunkLength,
+                                 bool isSequential) const;
+    //Precondition: pending entries for chunks are created by caller and
+    //they're removed and fulfilled here whatever happens. Permit is acquired
+    //with given priority unless it's passed already
+    std::vector<Chunk> FetchPending(std::span<Fill> fills,
+                                    std::span<std::promise<void>> promises,
+                                    FetchPriority priority,
+                                    internal::FetchScheduler::Permit permit = {});
+    //Must be called with source lock held, returns number of bytes read
+    std::size_t FetchSectors(std::span<Fill> fills, std::size_t contentLength);
+    //Must be called without cache lock held
+    MemoryBudget::Reservation ReserveMemory(std::size_t len);
+    //Must be called with cache lock held, sectors of fill become valid
+    //together with entry
+    void InsertIntoIndex(const Fill &fill);
+    //Must be called with cache lock held, returns false if nothing can be
+    //discarded
+    bool DiscardVictim() noexcept;
+    //Must be called with cache lock held
+    void ForEachChunkId(std::size_t pos, std::size_t len, auto &&func);
+
+    Access TrackAccess(std::size_t id) noexcept;
+    //Must be called with cache lock held
+    void ScheduleReadAhead(std::size_t lastId, std::size_t contentLength);
+    void ReadAheadLoop(std::stop_token stop);
+    //Does nothing if chunk is complete or pending already, errors are
+    //ignored because demand read will retry anyway
+    void PrefetchChunk(std::size_t id) noexcept;
+    void StopReadAhead() noexcept;
+};
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+CachedSource<SourceT, PolicyT>::CachedSource(SourceT source,
+                                             std::size_t maxChunks,
+                                             std::size_t chunkSize,
+                                             std::size_t readAhead,
+                                             std::shared_ptr<MemoryBudget> budget,
+                                             std::size_t sectorSize,
+                                             std::shared_ptr<ChunkArena> arena)
+    : mSrc{std::move(source)},
+      mShards{std::make_unique<Shard[]>(cNumShards)},
+      mScheduler{std::make_unique<internal::FetchScheduler>(GetMaxConcurrentReads(mSrc))},
+      mCacheMtx{std::make_unique<std::mutex>()},
+      mMaxChunks{maxChunks},
+      mChunkSize{chunkSize},
+      mSectorSize{sectorSize == 0 ? chunkSize : std::min(sectorSize, chunkSize)},
+      mSectorWords{mSectorSize > 0 ? (GetNumSectors(mChunkSize) + cBitsPerWord - 1) / cBitsPerWord : 0},
+      mReadAhead{std::min(readAhead, internal::CalcMaxReadAhead(maxChunks, chunkSize, budget.get()))},
+      mBudget{std::move(budget)},
+      mArena{arena ? std::move(arena)
+                   : std::make_shared<ChunkArena>(std::max(chunkSize, std::size_t{1}), cMaxFreeBuffers, false, mBudget)},
+      mContentLength{std::make_unique<std::atomic<std::size_t>>(std::numeric_limits<std::size_t>::max())},
+      mConsumedBytes{std::make_unique<std::atomic<std::size_t>>(0)},
+      mStreams{std::make_unique<Streams>()},
+      mReadAheadCv{std::make_unique<std::condition_variable_any>()}
+{
+    if(mChunkSize < 1)
+    {
+        throw ArgumentError{"chunk size must be greater than 0"};
+    }
+
+    if(mArena->BlockSize() < mChunkSize)
+    {
+        throw ArgumentError{"arena block size must be chunk size at least"};
+    }
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+CachedSource<SourceT, PolicyT>::CachedSource(CachedSource &&other)
+    //Background thread of other source must be stopped before anything
+    //is moved, so it's done in first member initializer
+    : mSrc{(other.StopReadAhead(), std::move(other.mSrc))},
+      mShards{std::move(other.mShards)},
+      mPolicy{std::move(other.mPolicy)},
+      mPinned{std::move(other.mPinned)},
+      mPending{std::move(other.mPending)},
+      mScheduler{std::move(other.mScheduler)},
+      mCacheMtx{std::move(other.mCacheMtx)},
+      mMaxChunks{other.mMaxChunks},
+      mChunkSize{other.mChunkSize},
+      mSectorSize{other.mSectorSize},
+      mSectorWords{other.mSectorWords},
+      mReadAhead{other.mReadAhead},
+      mBudget{other.mBudget},
+      mArena{other.mArena},
+      mContentLength{std::move(other.mContentLength)},
+      mConsumedBytes{std::move(other.mConsumedBytes)},
+      mFetchedBytes{other.mFetchedBytes},
+      mIsIndexAllocated{other.mIsIndexAllocated},
+      mStreams{std::move(other.mStreams)},
+      mReadAheadQueue{std::move(other.mReadAheadQueue)},
+      mReadAheadCv{std::move(other.mReadAheadCv)}
+{
+
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::size_t CachedSource<SourceT, PolicyT>::NumCachedChunks() const
+{
+    std::lock_guard lock(*mCacheMtx);
+    auto num = std::size_t{0};
+    for(std::size_t idx = 0; idx < cNumShards; ++idx)
+    {
+        num += mShards[idx].numEntries;
+    }
+    return num;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+CacheStats CachedSource<SourceT, PolicyT>::GetStats() const
+{
+    std::lock_guard lock(*mCacheMtx);
+    return CacheStats{.fetchedBytes = mFetchedBytes,
+                      .consumedBytes = mConsumedBytes->load(std::memory_order_relaxed)};
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::size_t CachedSource<SourceT, PolicyT>::GetContentLength() const
+{
+    static constexpr auto unknown = std::numeric_limits<std::size_t>::max();
+    if(auto length = mContentLength->load(std::memory_order_relaxed); length != unknown)
+    {
+        return length;
+    }
+
+    auto srcLock = LockSource();
+    auto length = mSrc.GetContentLength();
+    mContentLength->store(length, std::memory_order_relaxed);
+    return length;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::Read(std::size_t pos, std::span<std::byte> buf)
+{
+    auto remainder = buf.size_bytes();
+    auto outPtr = buf.data();
+    auto chunkId = GetChunkId(pos);
+    mConsumedBytes->fetch_add(remainder, std::memory_order_relaxed);
+
+    auto contentLength = std::size_t{0};
+    if(mReadAhead > 0 && remainder > 0)
+    {
+        contentLength = GetContentLength();
+    }
+
+    while(remainder > 0)
+    {
+        //Chunks are taken in windows, so misses of large read are fetched
+        //together instead of one round trip per chunk
+        auto lastId = std::min(GetChunkId(pos + remainder - 1),
+                               chunkId + cMaxCoalescedChunks - 1);
+        auto windowLen = std::min(remainder, (lastId + 1) * mChunkSize - pos);
+
+        //Read-ahead is scheduled before chunks are taken to overlap
+        //fetching of current and next chunks
+        auto access = Access::Random;
+        if(mReadAhead > 0)
+        {
+            for(auto id = chunkId; id <= lastId; ++id)
+            {
+                access = TrackAccess(id);
+            }
+        }
+
+        if(access == Access::Advanced)
+        {
+            std::lock_guard cacheLock(*mCacheMtx);
+            ScheduleReadAhead(lastId, contentLength);
+        }
+
+        for(const auto &chunk : GetChunks(pos, windowLen, access != Access::Random, FetchPriority::Demand))
+        {
+            auto offset = pos - (chunkId * mChunkSize);
+            auto len = std::min(remainder, mChunkSize - offset);
+
+            std::memcpy(outPtr, std::next(chunk.data.data(), offset), len);
+
+            std::advance(outPtr, len);
+            remainder -= len;
+            pos += len;
+            chunkId += 1;
+        }
+    }
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::optional<SourceView> CachedSource<SourceT, PolicyT>::View(std::size_t pos, std::size_t len)
+{
+    auto chunkId = GetChunkId(pos);
+    auto offset = pos - (chunkId * mChunkSize);
+    if(len > mChunkSize - offset)
+    {
+        if constexpr(ViewableSourceConcept<SourceT>)
+        {
+            auto lock = LockSource();
+            return mSrc.View(pos, len);
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+
+    auto chunk = GetChunks(pos, len, false, FetchPriority::Demand).front();
+    mConsumedBytes->fetch_add(len, std::memory_order_relaxed);
+
+    return SourceView{.data = chunk.data.subspan(offset, len),
+                      .owner = std::move(chunk.owner)};
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::Prefetch(std::size_t pos,
+                                              std::size_t len,
+                                              FetchPriority priority)
+{
+    GetChunks(pos, len, false, priority);
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+internal::FetchScheduler::Permit CachedSource<SourceT, PolicyT>::LockSource(FetchPriority priority) const
+{
+    return mScheduler->Acquire(priority);
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::size_t CachedSource<SourceT, PolicyT>::GetChunkId(std::size_t pos) const noexcept
+{
+    return pos / mChunkSize;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::size_t CachedSource<SourceT, PolicyT>::GetChunkLength(std::size_t id,
+                                                           std::size_t contentLength) const noexcept
+{
+    //It's essential that last chunk has exact size and not just mChunkSize
+    //because range check depends on it
+    return std::min(mChunkSize, contentLength - id * mChunkSize);
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::pair<std::size_t, std::size_t>
+    CachedSource<SourceT, PolicyT>::GetSectorRange(std::size_t from,
+                                                   std::size_t to,
+                                                   std::size_t numSectors) const noexcept
+{
+    auto first = std::min(from / mSectorSize, numSectors);
+    auto last = std::min(std::max((to + mSectorSize - 1) / mSectorSize, first + 1), numSectors);
+    return {first, last};
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::size_t CachedSource<SourceT, PolicyT>::GetNumSectors(std::size_t chunkLength) const noexcept
+{
+    return (chunkLength + mSectorSize - 1) / mSectorSize;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+typename CachedSource<SourceT, PolicyT>::Shard &
+    CachedSource<SourceT, PolicyT>::GetShard(std::size_t id) const noexcept
+{
+    return mShards[id % cNumShards];
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::AllocateIndex(std::size_t contentLength)
+{
+    if(mIsIndexAllocated)
+    {
+        return;
+    }
+
+    auto numChunks = (contentLength + mChunkSize - 1) / mChunkSize;
+    for(std::size_t idx = 0; idx < cNumShards; ++idx)
+    {
+        auto numSlots = numChunks / cNumShards + (idx < numChunks % cNumShards ? 1 : 0);
+        auto entries = std::vector<std::optional<Entry>>(numSlots);
+        auto valid = std::vector<std::uint64_t>(numSlots * mSectorWords);
+
+        auto &shard = mShards[idx];
+        std::lock_guard shardLock(shard.mtx);
+        shard.entries = std::move(entries);
+        shard.valid = std::move(valid);
+    }
+
+    mIsIndexAllocated = true;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+const typename CachedSource<SourceT, PolicyT>::Entry *
+    CachedSource<SourceT, PolicyT>::FindEntry(std::size_t id) const noexcept
+{
+    //Index may be not allocated yet, e.g. when range is pinned before reads
+    const auto &shard = GetShard(id);
+    auto slot = id / cNumShards;
+    return slot < shard.entries.size() && shard.entries[slot] ? &*shard.entries[slot] : nullptr;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+bool CachedSource<SourceT, PolicyT>::AreSectorsValid(std::size_t id,
+                                                     std::size_t first,
+                                                     std::size_t last) const noexcept
+{
+    const auto *words = std::next(GetShard(id).valid.data(), (id / cNumShards) * mSectorWords);
+    for(auto sector = first; sector < last; ++sector)
+    {
+        if(!((words[sector / cBitsPerWord] >> (sector % cBitsPerWord)) & 1))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::MarkValid(const Fill &fill) noexcept
+{
+    auto *words = std::next(GetShard(fill.id).valid.data(), (fill.id / cNumShards) * mSectorWords);
+    //Lent chunks are complete
+    auto isLent = fill.entry->buffer.empty();
+
+    if(fill.isAllocated)
+    {
+        std::fill_n(words, mSectorWords, std::uint64_t{0});
+    }
+
+    for(std::size_t sector = 0; sector < fill.sectors.size(); ++sector)
+    {
+        if(isLent || fill.sectors[sector])
+        {
+            words[sector / cBitsPerWord] |= std::uint64_t{1} << (sector % cBitsPerWord);
+        }
+    }
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::optional<typename CachedSource<SourceT, PolicyT>::Chunk>
+    CachedSource<SourceT, PolicyT>::TryHit(std::size_t id, std::size_t from, std::size_t to)
+{
+    auto &shard = GetShard(id);
+    std::lock_guard shardLock(shard.mtx);
+
+    const auto *entry = FindEntry(id);
+    if(!entry)
+    {
+        return std::nullopt;
+    }
+
+    auto [first, last] = GetSectorRange(from, to, GetNumSectors(entry->chunk.data.size()));
+    if(!AreSectorsValid(id, first, last))
+    {
+        return std::nullopt;
+    }
+
+    //Policy is updated later, losing some accesses is fine
+    if(shard.numTouches < cMaxBufferedTouches)
+    {
+        shard.touches[shard.numTouches++] = id;
+    }
+
+    return entry->chunk;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::optional<typename CachedSource<SourceT, PolicyT>::Chunk>
+    CachedSource<SourceT, PolicyT>::SearchInIndex(std::size_t id)
+{
+    if(const auto *entry = FindEntry(id); entry)
+    {
+        if(!mPinned.contains(id))
+        {
+            mPolicy.Touch(id);
+        }
+        return entry->chunk;
+    }
+
+    return std::nullopt;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::ApplyTouches() noexcept
+{
+    for(std::size_t idx = 0; idx < cNumShards; ++idx)
+    {
+        auto &shard = mShards[idx];
+        auto touches = std::array<std::size_t, cMaxBufferedTouches>{};
+        auto numTouches = std::size_t{0};
+
+        {
+            std::lock_guard shardLock(shard.mtx);
+            numTouches = std::exchange(shard.numTouches, 0);
+            std::copy_n(shard.touches.begin(), numTouches, touches.begin());
+        }
+
+        //Chunk may be discarded or pinned since it was accessed
+        for(std::size_t touch = 0; touch < numTouches; ++touch)
+        {
+            auto id = touches[touch];
+            if(FindEntry(id) && !mPinned.contains(id))
+            {
+                mPolicy.Touch(id);
+            }
+        }
+    }
+}
+
+//This function is quite large and complex but splitting it seems to be
+//bad idea, because it's better to see all process as a whole
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::vector<typename CachedSource<SourceT, PolicyT>::Chunk>
+    CachedSource<SourceT, PolicyT>::GetChunks(std::size_t pos,
+                                              std::size_t len,
+                                              bool isSequential,
+                                              FetchPriority priority)
+{
+    auto contentLength = GetContentLength();
+    internal::AssertRangeCorrect(pos, len, contentLength);
+
+    auto firstId = GetChunkId(pos);
+    auto lastId = len == 0 ? firstId : GetChunkId(pos + len - 1);
+    auto chunks = std::vector<std::optional<Chunk>>(lastId - firstId + 1);
+    //Returns bytes [from, to) of range within chunk and chunk length
+    auto getBounds =
+        [this, pos, len, contentLength](std::size_t id)
+        {
+            auto chunkPos = id * mChunkSize;
+            auto chunkLen = GetChunkLength(id, contentLength);
+            auto from = std::max(pos, chunkPos) - chunkPos;
+            auto to = std::min(pos + len, chunkPos + chunkLen) - chunkPos;
+            return std::tuple{from, to, chunkLen};
+        };
+
+    //Hits don't need cache lock at all
+    bool isWaiting = false;
+    for(auto id = firstId; id <= lastId; ++id)
+    {
+        auto [from, to, chunkLen] = getBounds(id);
+        chunks[id - firstId] = TryHit(id, from, to);
+        isWaiting = isWaiting || !chunks[id - firstId];
+    }
+
+    //Chunks filled by other threads are checked again after waiting, because
+    //those fills may not cover our range
+    while(isWaiting)
+    {
+        auto waiting = std::vector<std::shared_future<void>>{};
+        auto fills = std::vector<Fill>{};
+        auto promises = std::vector<std::promise<void>>{};
+
+        {
+            std::lock_guard cacheLock(*mCacheMtx);
+            AllocateIndex(contentLength);
+            for(auto id = firstId; id <= lastId; ++id)
+            {
+                auto &chunk = chunks[id - firstId];
+                if(chunk)
+                {
+                    continue;
+                }
+
+                auto [from, to, chunkLen] = getBounds(id);
+                if(auto fill = PlanFill(id, from, to, chunkLen, isSequential); !fill)
+                {
+                    chunk = SearchInIndex(id);
+                }
+                else if(auto it = mPending.find(id); it != mPending.end())
+                {
+                    //Someone is filling this chunk already, so we just wait
+                    waiting.push_back(it->second);
+                }
+                else
+                {
+                    fills.push_back(std::move(*fill));
+                }
+            }
+
+            promises.resize(fills.size());
+            auto numRegistered = std::size_t{0};
+            try
+            {
+                for(; numRegistered < fills.size(); ++numRegistered)
+                {
+                    mPending.emplace(fills[numRegistered].id,
+                                     promises[numRegistered].get_future().share());
+                }
+            }
+            catch(...)
+            {
+                //Nobody has seen these entries yet because lock is still held
+                for(std::size_t idx = 0; idx < numRegistered; ++idx)
+                {
+                    mPending.erase(fills[idx].id);
+                }
+                throw;
+            }
+        }
+
+        //Own chunks are filled before waiting for others, so threads never
+        //wait for each other in a cycle
+        if(!fills.empty())
+        {
+            auto filled = FetchPending(fills, promises, priority);
+            for(std::size_t idx = 0; idx < fills.size(); ++idx)
+            {
+                chunks[fills[idx].id - firstId] = std::move(filled[idx]);
+            }
+        }
+
+        for(auto &future : waiting)
+        {
+            future.get();
+        }
+
+        isWaiting = !waiting.empty();
+    }
+
+    auto result = std::vector<Chunk>{};
+    result.reserve(chunks.size());
+    for(auto &chunk : chunks)
+    {
+        result.push_back(std::move(*chunk));
+    }
+
+    return result;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::optional<typename CachedSource<SourceT, PolicyT>::Fill>
+    CachedSource<SourceT, PolicyT>::PlanFill(std::size_t id,
+                                             std::size_t from,
+                                             std::size_t to,
+                                             std::size_t chunkLength,
+                                             bool isSequential) const
+{
+    auto numSectors = GetNumSectors(chunkLength);
+    auto [first, last] = GetSectorRange(from, to, numSectors);
+
+    auto fill = Fill{.id = id, .entry = std::nullopt, .sectors = std::vector<bool>(numSectors)};
+    if(const auto *entry = FindEntry(id); entry)
+    {
+        fill.entry = *entry;
+    }
+
+    auto isValid =
+        [this, &fill](std::size_t sector)
+        {
+            return fill.entry && AreSectorsValid(fill.id, sector, sector + 1);
+        };
+
+    auto missing = first;
+    while(missing < last && isValid(missing))
+    {
+        ++missing;
+    }
+
+    if(fill.entry && missing == last)
+    {
+        return std::nullopt;
+    }
+
+    if(isSequential)
+    {
+        last = numSectors;
+    }
+    else
+    {
+        //Fill is as long as valid run preceding it at least, so repeated
+        //small reads of chunk double its valid part every time
+        auto run = std::size_t{0};
+        while(run < missing && isValid(missing - run - 1))
+        {
+            ++run;
+        }
+        last = std::min(std::max(last, missing + run), numSectors);
+    }
 
-std::string_view ExtractAddress(std::string_view url);
-std::string_view ExtractPathAndQuery(std::string_view url);
+    for(auto sector = missing; sector < last; ++sector)
+    {
+        fill.sectors[sector] = !isValid(sector);
+    }
 
-} //namespace internal
+    return fill;
+}
 
-//Class to access web resource by HTTP(S) protocol. Establish keep-alive connection on creation.
-//If server doesn't support range requests (or range unit isn't byte), content is downloaded
-//and cached on first Read invocation.
-class HttpSource final
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::vector<typename CachedSource<SourceT, PolicyT>::Chunk>
+    CachedSource<SourceT, PolicyT>::FetchPending(std::span<Fill> fills,
+                                                 std::span<std::promise<void>> promises,
+                                                 FetchPriority priority,
+                                                 internal::FetchScheduler::Permit permit)
 {
-public:
-    explicit HttpSource(const std::string &url);
-    HttpSource(const HttpSource &) = delete;
-    HttpSource &operator=(const HttpSource &) = delete;
-    HttpSource(HttpSource &&) = default;
-    HttpSource &operator=(HttpSource &&) = default;
+    try
+    {
+        auto contentLength = GetContentLength();
 
-    std::size_t GetContentLength() const noexcept;
-    //Reading zero bytes performs no operation and returns immediately
-    void Read(std::size_t pos, std::span<std::byte> buf);
+        auto numBytes =
+            [this, fills, contentLength, priority, &permit]()
+            {
+                if(!permit)
+                {
+                    permit = LockSource(priority);
+                }
 
-private:
-    //Only reason for it to be unique_ptr is the fact that Client doesn't
-    //implement move assignment operator (likely by mistake, not by design)
-    std::unique_ptr<httplib::Client> mHttpClient;
-    std::string mRequestStr; 
-    std::vector<std::byte> mCache;
-    std::size_t mContentLength;
-    bool mIsRangeSupported;
+                auto srcPermit = std::move(permit);
+                return FetchSectors(fills, contentLength);
+            }();
 
-    httplib::Headers EstablishConnection(std::string url);
-    void Cache();
-    //Returns reference to result member
-    const httplib::Response &AssertRequestSuccessful(
-        const httplib::Result& result,
-        httplib::StatusCode expectedCode = httplib::StatusCode::OK_200) const;
-    static void AssertResponseLengthCorrect(std::size_t requested, std::size_t actual);
-};
+        auto chunks = std::vector<Chunk>{};
+        chunks.reserve(fills.size());
 
-static_assert(std::is_nothrow_move_assignable_v<HttpSource>);
-static_assert(std::is_nothrow_move_constructible_v<HttpSource>);
+        {
+            std::lock_guard cacheLock(*mCacheMtx);
+            mFetchedBytes += numBytes;
+            for(auto &fill : fills)
+            {
+                mPending.erase(fill.id);
+                //Nobody else fills this chunk, so entry is either ours or
+                //it has been discarded meanwhile
+                if(!FindEntry(fill.id))
+                {
+                    InsertIntoIndex(fill);
+                }
+                else
+                {
+                    std::lock_guard shardLock(GetShard(fill.id).mtx);
+                    MarkValid(fill);
+                }
+                chunks.push_back(fill.entry->chunk);
+            }
+        }
 
+        for(auto &promise : promises)
+        {
+            promise.set_value();
+        }
+        return chunks;
+    }
+    catch(...)
+    {
+        {
+            std::lock_guard cacheLock(*mCacheMtx);
+            for(const auto &fill : fills)
+            {
+                mPending.erase(fill.id);
+            }
+        }
 
+        for(auto &promise : promises)
+        {
+            promise.set_exception(std::current_exception());
+        }
+        throw;
+    }
+}
 
-class MemoryViewSource final
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+std::size_t CachedSource<SourceT, PolicyT>::FetchSectors(std::span<Fill> fills,
+                                                         std::size_t contentLength)
 {
-public:
-    explicit MemoryViewSource(std::span<const std::byte> buf = {});
+    //Reservation and block are returned when chunk memory is freed, which
+    //may happen long after chunk is discarded if it's viewed. Reservation is
+    //returned first, so arena sees room for keeping the block
+    struct Buffer
+    {
+        ChunkArena::Block block;
+        MemoryBudget::Reservation reservation;
+    };
 
-    std::size_t GetContentLength() const noexcept;
-    void Read(std::size_t pos, std::span<std::byte> buf);
+    auto requests = std::vector<ReadRequest>{};
+    auto numBytes = std::size_t{0};
 
-private:
-    std::span<const std::byte> mBuf;
-};
+    for(auto &fill : fills)
+    {
+        auto offset = fill.id * mChunkSize;
+        auto len = GetChunkLength(fill.id, contentLength);
+        auto numSectors = fill.sectors.size();
 
+        if(!fill.entry)
+        {
+            if constexpr(ViewableSourceConcept<SourceT>)
+            {
+                if(auto view = mSrc.View(offset, len); view)
+                {
+                    fill.entry = Entry{.chunk = std::move(*view), .buffer = {}};
+                    fill.isAllocated = true;
+                    continue;
+                }
+            }
 
+            //Whole block memory is accounted, because short last chunk
+            //occupies it anyway. Discarded chunks return blocks to arena
+            //before allocation, so they're reused
+            auto reservation = ReserveMemory(mArena->MemorySize());
+            auto buf = std::make_shared<Buffer>(mArena->Allocate(), std::move(reservation));
+            auto span = buf->block.Data().first(len);
+            fill.entry = Entry{.chunk = Chunk{.data = span, .owner = std::move(buf)},
+                               .buffer = span};
+            fill.isAllocated = true;
+        }
 
-//File size is cached in constructor, shared access to underlying file
-//is not supposed to happen, there will be issues
-class FileSource final
-{
-public:
-    explicit FileSource(const std::filesystem::path &path);
+        //Every run of sectors is read separately, because valid sectors
+        //mustn't be written while they may be read by others
+        for(std::size_t first = 0; first < numSectors;)
+        {
+            if(!fill.sectors[first])
+            {
+                ++first;
+                continue;
+            }
 
-    FileSource(const FileSource &) = delete;
-    FileSource &operator=(const FileSource &) = delete;
-    FileSource(FileSource &&) = default;
-    FileSource &operator=(FileSource &&) = default;
+            auto last = first;
+            while(last < numSectors && fill.sectors[last])
+            {
+                ++last;
+            }
 
-    std::size_t GetContentLength() const noexcept;
-    void Read(std::size_t pos, std::span<std::byte> buf);
+            auto runPos = first * mSectorSize;
+            auto runLen = std::min(last * mSectorSize, len) - runPos;
+            requests.push_back(ReadRequest{.pos = offset + runPos,
+                                           .buf = fill.entry->buffer.subspan(runPos, runLen)});
+            numBytes += runLen;
+            first = last;
+        }
+    }
 
-private:
-    std::ifstream mFile;
-    std::size_t mSize;
-    std::ifstream::pos_type mStart;
-};
+    //Adjacent ranges are read by single request if source supports it
+    vd::ReadV(mSrc, requests);
+
+    return numBytes;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+MemoryBudget::Reservation CachedSource<SourceT, PolicyT>::ReserveMemory(std::size_t len)
+{
+    if(!mBudget)
+    {
+        return MemoryBudget::Reservation{};
+    }
 
+    std::lock_guard cacheLock(*mCacheMtx);
+    auto reservation = mBudget->TryReserve(len);
+    //Free blocks of arena don't fit into budget anymore
+    if(!reservation)
+    {
+        mArena->Trim();
+    }
 
+    //Memory of other sources and viewed chunks is out of our control, so
+    //only own chunks are discarded
+    while(!reservation && DiscardVictim())
+    {
+        reservation = mBudget->TryReserve(len);
+    }
 
-//Wrapper for buffering read operations on sources.
-//It is thread safe natively also.
-//MaxChunks parameter sets maximum amount of cached chunks (unlimited if 0)
-template <SourceConcept SourceT>
-class CachedSource final
+    return reservation ? std::move(*reservation) : mBudget->Reserve(len);
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::InsertIntoIndex(const Fill &fill)
 {
-public:
-    static const std::size_t cDefaultChunkSize = 1 << 19;
+    auto id = fill.id;
+    auto &shard = GetShard(id);
+    auto &slot = shard.entries[id / cNumShards];
+    //Hits take only shard lock, so they mustn't see new entry with valid
+    //sectors of discarded one
+    auto publish =
+        [this, &fill, &shard, &slot]()
+        {
+            std::lock_guard shardLock(shard.mtx);
+            MarkValid(fill);
+            slot = *fill.entry;
+            shard.numEntries += 1;
+        };
 
-    explicit CachedSource(SourceT source,
-                          std::size_t maxChunks = 1,
-                          std::size_t chunkSize = cDefaultChunkSize);
-    CachedSource(const CachedSource &) = delete;
-    CachedSource &operator=(const CachedSource &) = delete;
-    CachedSource(CachedSource &&) = default;
-    CachedSource &operator=(CachedSource &&) = default;
-    ~CachedSource() = default;
+    if(mPinned.contains(id))
+    {
+        publish();
+        return;
+    }
 
-    std::size_t NumCachedChunks() const;
-    std::size_t GetContentLength() const;
-    //Reading zero bytes performs no operation and returns immediately
-    void Read(std::size_t pos, std::span<std::byte> buf);
+    if(mMaxChunks != 0 && !(mPolicy.Size() < mMaxChunks))
+    {
+        DiscardVictim();
+    }
 
-private:
-    using Chunk = std::vector<std::byte>;
+    publish();
 
-    struct Entry
+    try
     {
-        std::size_t id;
-        std::shared_ptr<Chunk> chunk;
-    };
+        mPolicy.Insert(id);
+    }
+    catch(...)
+    {
+        std::lock_guard shardLock(shard.mtx);
+        slot.reset();
+        shard.numEntries -= 1;
+        throw;
+    }
+}
 
-    using Entries = std::list<Entry>;
-    using Index = std::unordered_map<std::size_t, typename Entries::iterator>;
-    
-    SourceT mSrc;
-    Index mIndex;
-    Entries mEntries;
-    mutable std::unique_ptr<std::mutex> mSrcMtx;
-    mutable std::unique_ptr<std::mutex> mCacheMtx;
-    const std::size_t mMaxChunks;
-    const std::size_t mChunkSize;
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+bool CachedSource<SourceT, PolicyT>::DiscardVictim() noexcept
+{
+    //Recent hits must be known to policy to choose victim well
+    ApplyTouches();
 
-    std::size_t GetChunkId(std::size_t pos) const noexcept;
-    std::shared_ptr<Chunk> SearchInIndex(std::size_t id);
-    //In case of exception oldest chunk may be discarded but new chunk won't be inserted into cache
-    std::shared_ptr<Chunk> GetChunk(std::size_t id);
-    //Precondition: at least 1 item is in cache
-    void DiscardOldestChunk() noexcept;
-};
+    auto id = mPolicy.Evict();
+    if(!id)
+    {
+        return false;
+    }
 
-template <SourceConcept SourceT>
-CachedSource<SourceT>::CachedSource(SourceT source,
-                                    std::size_t maxChunks,
-                                    std::size_t chunkSize)
-    : mSrc{std::move(source)},
-      mSrcMtx{std::make_unique<std::mutex>()},
-      mCacheMtx{std::make_unique<std::mutex>()},
-      mMaxChunks{maxChunks},
-      mChunkSize{chunkSize}
+    //Valid sectors are kept, because chunk may still be filled by fetch which
+    //reinserts it
+    auto &shard = GetShard(*id);
+    std::lock_guard shardLock(shard.mtx);
+    shard.entries[*id / cNumShards].reset();
+    shard.numEntries -= 1;
+    return true;
+}
+
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::ForEachChunkId(std::size_t pos,
+                                                    std::size_t len,
+                                                    auto &&func)
 {
-    if(mChunkSize < 1)
+    if(len == 0)
     {
-        throw ArgumentError{"chunk size must be greater than 0"};
+        return;
+    }
+
+    auto last = GetChunkId(Add<std::size_t>(pos, len - 1));
+    for(auto id = GetChunkId(pos); id <= last; ++id)
+    {
+        func(id);
     }
 }
 
-template <SourceConcept SourceT>
-std::size_t CachedSource<SourceT>::NumCachedChunks() const
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::Pin(std::size_t pos, std::size_t len)
 {
-    std::lock_guard lock(*mCacheMtx);
-    return mIndex.size();
+    std::lock_guard cacheLock(*mCacheMtx);
+    ForEachChunkId(
+        pos,
+        len,
+        [this](std::size_t id)
+        {
+            if(mPinned.insert(id).second && FindEntry(id))
+            {
+                mPolicy.Erase(id);
+            }
+        });
 }
 
-template <SourceConcept SourceT>
-std::size_t CachedSource<SourceT>::GetContentLength() const
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::Unpin(std::size_t pos, std::size_t len)
 {
-    std::lock_guard lock(*mSrcMtx);
-    return mSrc.GetContentLength();
+    std::lock_guard cacheLock(*mCacheMtx);
+    ForEachChunkId(
+        pos,
+        len,
+        [this](std::size_t id)
+        {
+            if(!mPinned.contains(id) || !FindEntry(id))
+            {
+                mPinned.erase(id);
+                return;
+            }
+
+            //Chunk is still pinned while victim is chosen, so its buffered
+            //accesses aren't passed to policy before it's tracked
+            if(mMaxChunks != 0 && !(mPolicy.Size() < mMaxChunks))
+            {
+                DiscardVictim();
+            }
+            //Pin is dropped only after policy tracks chunk, otherwise failed
+            //insertion would leave it neither pinned nor evictable
+            mPolicy.Insert(id);
+            mPinned.erase(id);
+        });
 }
 
-template <SourceConcept SourceT>
-void CachedSource<SourceT>::Read(std::size_t pos, std::span<std::byte> buf)
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+typename CachedSource<SourceT, PolicyT>::Access CachedSource<SourceT, PolicyT>::TrackAccess(std::size_t id) noexcept
 {
-    auto remainder = buf.size_bytes();
-    auto outPtr = buf.data();
-    auto chunkId = GetChunkId(pos);
-    while(remainder > 0)
+    static constexpr auto lengthMask = (std::size_t{1} << cStreamLengthBits) - 1;
+
+    //Such ids don't fit into stream
+    if(id > (std::numeric_limits<std::size_t>::max() >> cStreamLengthBits))
     {
-        auto chunk = GetChunk(chunkId);
+        return Access::Random;
+    }
+
+    auto classify =
+        [id](std::size_t stream, Access advanced)
+        {
+            auto isSequential = (stream >> cStreamLengthBits) == id &&
+                                (stream & lengthMask) >= cSequentialThreshold;
+            return isSequential ? advanced : Access::Random;
+        };
 
-        auto offset = pos - (chunkId * mChunkSize);
-        auto len = std::min(remainder, mChunkSize - offset);
+    for(auto &slot : mStreams->slots)
+    {
+        auto stream = slot.load(std::memory_order_relaxed);
+        if(stream == 0)
+        {
+            continue;
+        }
 
-        //This check is needed because we disabled initial check but
-        //last chunk may be shorter than others and need special care
-        internal::AssertRangeCorrect(offset, len, chunk->size());
+        auto lastId = stream >> cStreamLengthBits;
+        //Same chunk is accessed again, nothing changes
+        if(lastId == id)
+        {
+            return classify(stream, Access::Sequential);
+        }
 
-        std::memcpy(outPtr, std::next(chunk->data(), offset), len);
+        if(lastId + 1 == id)
+        {
+            auto length = std::min((stream & lengthMask) + 1, lengthMask);
+            auto advanced = (id << cStreamLengthBits) | length;
+            if(slot.compare_exchange_strong(stream, advanced, std::memory_order_relaxed))
+            {
+                return classify(advanced, Access::Advanced);
+            }
 
-        std::advance(outPtr, len);
-        remainder -= len;
-        pos += len;
-        chunkId += 1;
+            //Another reader has advanced or replaced stream meanwhile
+            return classify(stream, Access::Sequential);
+        }
     }
-}
 
-template <SourceConcept SourceT>
-std::size_t CachedSource<SourceT>::GetChunkId(std::size_t pos) const noexcept
-{
-    return pos / mChunkSize;
+    auto next = mStreams->next.fetch_add(1, std::memory_order_relaxed);
+    mStreams->slots[next % cMaxStreams].store((id << cStreamLengthBits) | 1, std::memory_order_relaxed);
+    return Access::Random;
 }
 
-template <SourceConcept SourceT>
-std::shared_ptr<typename CachedSource<SourceT>::Chunk>
-    CachedSource<SourceT>::SearchInIndex(std::size_t id)
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::ScheduleReadAhead(std::size_t lastId, std::size_t contentLength)
 {
-    auto indexIt = mIndex.find(id);
-    if(indexIt != mIndex.end())
+    bool scheduled = false;
+    for(auto id = lastId + 1; id <= lastId + mReadAhead; ++id)
+    {
+        if(id * mChunkSize >= contentLength)
+        {
+            break;
+        }
+
+        const auto *entry = FindEntry(id);
+        if((entry && AreSectorsValid(id, 0, GetNumSectors(entry->chunk.data.size()))) ||
+           mPending.contains(id) ||
+           std::ranges::find(mReadAheadQueue, id) != mReadAheadQueue.end())
+        {
+            continue;
+        }
+
+        mReadAheadQueue.push_back(id);
+        scheduled = true;
+    }
+
+    if(!scheduled)
     {
-        mEntries.splice(mEntries.end(), mEntries, indexIt->second);
-        return indexIt->second->chunk;
+        return;
     }
 
-    return nullptr;
+    //Too old requests are likely useless already
+    while(mReadAheadQueue.size() > mReadAhead * cMaxStreams)
+    {
+        mReadAheadQueue.pop_front();
+    }
+
+    if(!mReadAheadThread.joinable())
+    {
+        mReadAheadThread =
+            std::jthread{
+                [this](std::stop_token stop)
+                {
+                    ReadAheadLoop(stop);
+                }};
+    }
+
+    mReadAheadCv->notify_one();
 }
 
-//This function is quite large and complex but splitting it seems to be
-//bad idea, because it's better to see all process as a whole
-template <SourceConcept SourceT>
-std::shared_ptr<typename CachedSource<SourceT>::Chunk>
-    CachedSource<SourceT>::GetChunk(std::size_t id)
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::ReadAheadLoop(std::stop_token stop)
 {
+    while(true)
     {
-        std::lock_guard cacheLock(*mCacheMtx);
-        if(auto chunk = SearchInIndex(id); chunk)
+        std::size_t id;
+
         {
-            return chunk;
+            std::unique_lock cacheLock(*mCacheMtx);
+            auto ready =
+                mReadAheadCv->wait(
+                    cacheLock,
+                    stop,
+                    [this]()
+                    {
+                        return !mReadAheadQueue.empty();
+                    });
+
+            if(!ready)
+            {
+                return;
+            }
+
+            id = mReadAheadQueue.front();
+            mReadAheadQueue.pop_front();
         }
+
+        PrefetchChunk(id);
     }
+}
 
-    auto offset = id * mChunkSize;
-    
-    //GetContentLength() is thread safe already, no lock is needed
-    auto len = std::min(mChunkSize, GetContentLength() - offset);
-    
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::PrefetchChunk(std::size_t id) noexcept
+{
+    try
     {
-        std::lock_guard srcLock(*mSrcMtx);
+        auto contentLength = GetContentLength();
+        auto chunkLen = GetChunkLength(id, contentLength);
+        auto promise = std::promise<void>{};
+
+        //Must be called with cache lock held, nullopt if there's nothing to fetch
+        auto plan =
+            [this, id, contentLength, chunkLen]() -> std::optional<Fill>
+            {
+                if(mPending.contains(id))
+                {
+                    return std::nullopt;
+                }
+
+                AllocateIndex(contentLength);
+                //Whole chunk is expected to be read soon
+                return PlanFill(id, 0, chunkLen, chunkLen, true);
+            };
 
-        //We have to search in index again because someone could put requested
-        //chunk there while we were waiting on mutex
         {
             std::lock_guard cacheLock(*mCacheMtx);
-            if(auto chunk = SearchInIndex(id); chunk)
+            if(!plan())
             {
-                return chunk;
+                return;
             }
         }
 
-        //It's essential that last chunk has exact size and not just mChunkSize
-        //because range check depends on it
-        auto newChunk = std::make_shared<Chunk>(len);
-        auto span = std::span<std::byte>{newChunk->data(), len};
+        //Chunk is marked pending only when fetch may start, otherwise
+        //demand reads of it would wait for speculative fetch to be allowed.
+        //It may be fetched by them while permit is awaited, so plan is
+        //made again
+        auto permit = LockSource(FetchPriority::Speculative);
+        auto fill = std::optional<Fill>{};
 
-        mSrc.Read(offset, span);
-
-        //Here we can be sure that chunk doesn't exist in index because it's
-        //impossible to obtain chunk while source mutex is locked
         {
             std::lock_guard cacheLock(*mCacheMtx);
-
-            if(mMaxChunks != 0 && !(mIndex.size() < mMaxChunks))
+            fill = plan();
+            if(!fill)
             {
-                DiscardOldestChunk();
+                return;
             }
 
-            mEntries.push_back(Entry{.id = id, .chunk = newChunk});
-            try
-            {
-                mIndex.insert(std::make_pair(id, std::prev(mEntries.end())));
-            }
-            catch(...)
-            {
-                static_assert(noexcept(mEntries.pop_back()));
-                mEntries.pop_back();
-                throw;
-            }
+            mPending.emplace(id, promise.get_future().share());
         }
 
-        return newChunk;
+        FetchPending(std::span{&*fill, 1},
+                     std::span{&promise, 1},
+                     FetchPriority::Speculative,
+                     std::move(permit));
     }
+    catch(...) {}
 }
 
-template <SourceConcept SourceT>
-void CachedSource<SourceT>::DiscardOldestChunk() noexcept
+template <SourceConcept SourceT, EvictionPolicyConcept PolicyT>
+void CachedSource<SourceT, PolicyT>::StopReadAhead() noexcept
 {
-    mIndex.erase(mEntries.front().id);
-    mEntries.pop_front();
+    if(mReadAheadThread.joinable())
+    {
+        mReadAheadThread.request_stop();
+        mReadAheadThread.join();
+    }
 }
 
 
@@ -338,6 +2546,8 @@ public:
 
     std::size_t GetContentLength() const;
     void Read(std::size_t pos, std::span<std::byte> buf);
+    std::optional<SourceView> View(std::size_t pos, std::size_t len)
+        requires ViewableSourceConcept<SourceT>;
 
 private:
     SourceT mSrc;
@@ -366,6 +2576,14 @@ void ThreadSafeSource<SourceT>::Read(std::size_t pos, std::span<std::byte> buf)
     return mSrc.Read(pos, buf);
 }
 
+template <SourceConcept SourceT>
+std::optional<SourceView> ThreadSafeSource<SourceT>::View(std::size_t pos, std::size_t len)
+    requires ViewableSourceConcept<SourceT>
+{
+    auto lock = std::lock_guard{*mMutex};
+    return mSrc.View(pos, len);
+}
+
 
 
 class SourceBase
@@ -375,10 +2593,13 @@ public:
 
     std::size_t GetContentLength() const;
     void Read(std::size_t pos, std::span<std::byte> buf);
+    //Returns nullopt if underlying source can't lend requested range
+    std::optional<SourceView> View(std::size_t pos, std::size_t len);
 
 protected:
     virtual std::size_t GetContentLengthOverride() const = 0;
     virtual void ReadOverride(std::size_t pos, std::span<std::byte> buf) = 0;
+    virtual std::optional<SourceView> ViewOverride(std::size_t pos, std::size_t len) = 0;
 };
 
 template <SourceConcept SourceT>
@@ -394,9 +2615,14 @@ public:
 
     ~Source() override = default;
 
+    //Gives access to things not exposed by SourceBase
+    SourceT &Get() noexcept;
+    const SourceT &Get() const noexcept;
+
 protected:
     virtual std::size_t GetContentLengthOverride() const override;
     virtual void ReadOverride(std::size_t pos, std::span<std::byte> buf) override;
+    virtual std::optional<SourceView> ViewOverride(std::size_t pos, std::size_t len) override;
 
 private:
     SourceT mSrc;
@@ -409,6 +2635,18 @@ Source<SourceT>::Source(SourceT source)
 
 }
 
+template <SourceConcept SourceT>
+SourceT &Source<SourceT>::Get() noexcept
+{
+    return mSrc;
+}
+
+template <SourceConcept SourceT>
+const SourceT &Source<SourceT>::Get() const noexcept
+{
+    return mSrc;
+}
+
 template <SourceConcept SourceT>
 std::size_t Source<SourceT>::GetContentLengthOverride() const
 {
@@ -421,6 +2659,19 @@ void Source<SourceT>::ReadOverride(std::size_t pos, std::span<std::byte> buf)
     mSrc.Read(pos, buf);
 }
 
+template <SourceConcept SourceT>
+std::optional<SourceView> Source<SourceT>::ViewOverride(std::size_t pos, std::size_t len)
+{
+    if constexpr(ViewableSourceConcept<SourceT>)
+    {
+        return mSrc.View(pos, len);
+    }
+    else
+    {
+        return std::nullopt;
+    }
+}
+
 } //namespace vd
 
 #endif //VDOWNLOADER_VD_SOURCES_H_
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "ThreadPool.h"
+#include "Errors.h"
+#include "Utils.h"
+
+namespace vd
+{
+
+ThreadPool::ThreadPool(std::size_t numThreads)
+{
+    if(numThreads == 0)
+    {
+        throw ArgumentError{"number of threads must be greater than 0"};
+    }
+
+    mQueues.reserve(numThreads);
+    for(std::size_t i = 0; i < numThreads; ++i)
+    {
+        mQueues.push_back(std::make_unique<Queue>());
+    }
+
+    mThreads.reserve(numThreads);
+    for(std::size_t i = 0; i < numThreads; ++i)
+    {
+        mThreads.emplace_back([this, i]() { Run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{mMtx};
+        mIsStopping = true;
+    }
+    mCv.notify_all();
+
+    mThreads.clear();
+}
+
+std::size_t ThreadPool::NumThreads() const noexcept
+{
+    return mQueues.size();
+}
+
+void ThreadPool::Push(std::size_t worker, Task task)
+{
+    if(worker >= mQueues.size())
+    {
+        throw RangeError{Format("worker {} is requested, but pool has only {}", worker, mQueues.size())};
+    }
+
+    {
+        //Counter is updated under the same lock, so it isn't decremented by
+        //thief before incremented
+        std::lock_guard lock{mMtx};
+        auto &queue = *mQueues[worker];
+        std::lock_guard queueLock{queue.mtx};
+        queue.tasks.push_back(std::move(task));
+        ++mNumQueued;
+    }
+    mCv.notify_one();
+}
+
+std::optional<ThreadPool::Task> ThreadPool::Take(std::size_t worker)
+{
+    auto res = std::optional<Task>{};
+
+    for(std::size_t i = 0; i < mQueues.size() && !res; ++i)
+    {
+        auto victim = (worker + i) % mQueues.size();
+        auto &queue = *mQueues[victim];
+
+        std::lock_guard lock{queue.mtx};
+        if(queue.tasks.empty())
+        {
+            continue;
+        }
+
+        if(victim == worker)
+        {
+            res = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        else
+        {
+            res = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    if(res)
+    {
+        std::lock_guard lock{mMtx};
+        --mNumQueued;
+    }
+
+    return res;
+}
+
+void ThreadPool::Run(std::size_t worker)
+{
+    while(true)
+    {
+        if(auto task = Take(worker))
+        {
+            (*task)(worker);
+            continue;
+        }
+
+        std::unique_lock lock{mMtx};
+        mCv.wait(lock, [this]() { return mIsStopping || mNumQueued > 0; });
+        if(mIsStopping && mNumQueued == 0)
+        {
+            return;
+        }
+    }
+}
+
+} //namespace vd
@@ -0,0 +1,71 @@
+#ifndef VDOWNLOADER_VD_THREAD_POOL_H_
+#define VDOWNLOADER_VD_THREAD_POOL_H_
+
+#include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace vd
+{
+
+//Fixed set of workers, each has its own queue of tasks taken from the front.
+//Idle worker steals from the back of other queues, so tasks submitted to a
+//worker in order are mostly run by it in that order
+class ThreadPool final
+{
+public:
+    explicit ThreadPool(std::size_t numThreads);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ThreadPool(ThreadPool &&) = delete;
+    ThreadPool &operator=(ThreadPool &&) = delete;
+    //Queued tasks are run before workers are joined
+    ~ThreadPool();
+
+    std::size_t NumThreads() const noexcept;
+    //Task gets index of worker running it. Exceptions are reported through
+    //future
+    template <std::invocable<std::size_t> F>
+    std::future<void> Submit(std::size_t worker, F &&func);
+
+private:
+    using Task = std::packaged_task<void(std::size_t)>;
+
+    struct Queue
+    {
+        std::deque<Task> tasks;
+        std::mutex mtx;
+    };
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::size_t mNumQueued{0};
+    bool mIsStopping{false};
+    std::mutex mMtx;
+    std::condition_variable mCv;
+    //Declared last to be joined before the rest is destroyed
+    std::vector<std::jthread> mThreads;
+
+    void Push(std::size_t worker, Task task);
+    std::optional<Task> Take(std::size_t worker);
+    void Run(std::size_t worker);
+};
+
+template <std::invocable<std::size_t> F>
+std::future<void> ThreadPool::Submit(std::size_t worker, F &&func)
+{
+    auto task = Task{std::forward<F>(func)};
+    auto res = task.get_future();
+    Push(worker, std::move(task));
+
+    return res;
+}
+
+} //namespace vd
+
+#endif //VDOWNLOADER_VD_THREAD_POOL_H_
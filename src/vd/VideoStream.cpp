@@ -2,9 +2,12 @@
 #include "Libav.h"
 
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <future>
 #include <ranges>
 #include <span>
+#include <thread>
 
 namespace vd
 {
@@ -86,13 +89,44 @@ struct MediaContext final
     UniquePtr<AVPacket> packet;
 };
 
+struct ProbedMedia final
+{
+    struct Stream final
+    {
+        UniquePtr<AVCodecParameters> codecpar;
+        AVRational timeBase;
+        std::int64_t startTime;
+        std::int64_t duration;
+        AVRational avgFrameRate;
+        AVRational rFrameRate;
+    };
+
+    struct IndexEntry final
+    {
+        std::int64_t pos;
+        std::int64_t timestamp;
+        int size;
+        int distance;
+        int flags;
+    };
+
+    const AVInputFormat *format;
+    std::int64_t duration;
+    std::vector<Stream> streams;
+    int streamIndex;
+    //Index of picked stream only
+    std::vector<IndexEntry> index;
+};
+
 namespace
 {
 
 std::pair<std::unique_ptr<MediaContext>, AVStream *>
-    CreateMediaContext(std::unique_ptr<Reader> &&reader,
-                       const StreamPicker &picker,
-                       bool skipNonRef);
+    CreateMediaContext(std::unique_ptr<Reader> &&reader, const OpeningParams &params);
+std::shared_ptr<const ProbedMedia> MakeProbedMedia(const AVFormatContext &ctx, AVStream &stream);
+std::vector<std::byte> SerializeProbedMedia(const ProbedMedia &probed);
+//Throws Error if data is malformed or was written by other libavformat version
+std::shared_ptr<const ProbedMedia> ParseProbedMedia(std::span<const std::byte> data);
 void AssertPtsIsSet(const AVFrame &frame);
 void AssertNextPtsIsNotLess(const AVFrame &l, const AVFrame &r);
 
@@ -100,31 +134,110 @@ void AssertNextPtsIsNotLess(const AVFrame &l, const AVFrame &r);
 
 
 
+std::shared_ptr<const ProbedMedia> ProbeMediaSource(ReaderFactory readerFactory,
+                                                    const StreamPicker &picker)
+{
+    auto params = OpeningParams{};
+    params.picker = picker;
+
+    auto [ctx, stream] = CreateMediaContext(readerFactory(), params);
+    return MakeProbedMedia(*ctx->formatCtx, *stream);
+}
+
+void SaveProbedMedia(const std::filesystem::path &path, const ProbedMedia &probed)
+{
+    auto data = SerializeProbedMedia(probed);
+
+    //Other program instances may read or write the same file at the same
+    //time, renaming is atomic, so nobody sees partially written one
+    auto tmpPath = path;
+    tmpPath += Format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    try
+    {
+        auto of = std::ofstream(tmpPath, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        of.write(reinterpret_cast<const char *>(data.data()), IntCast<std::streamsize>(data.size()));
+        of.close();
+        if(!of)
+        {
+            throw Error{Format(R"(failed to write file "{}")", tmpPath.string())};
+        }
+
+        std::filesystem::rename(tmpPath, path);
+    }
+    catch(...)
+    {
+        auto ec = std::error_code{};
+        std::filesystem::remove(tmpPath, ec);
+        throw;
+    }
+}
+
+std::shared_ptr<const ProbedMedia> LoadProbedMedia(const std::filesystem::path &path)
+{
+    auto in = std::ifstream(path, std::ios_base::binary);
+    if(!in)
+    {
+        return nullptr;
+    }
+
+    auto data = std::string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+    try
+    {
+        return ParseProbedMedia(std::as_bytes(std::span{data}));
+    }
+    catch(const Error &)
+    {
+        //File may be written by other program instance right now
+        return nullptr;
+    }
+}
+
+std::vector<Nanoseconds> GetKeyframeTimestamps(const ProbedMedia &probed)
+{
+    const auto &stream = probed.streams[IntCast<std::size_t>(probed.streamIndex)];
+    auto startTime = stream.startTime != AV_NOPTS_VALUE ? stream.startTime : 0;
+
+    //Index is kept sorted by demuxer
+    auto res = std::vector<Nanoseconds>{};
+    for(const auto &entry : probed.index)
+    {
+        if(entry.flags & AVINDEX_KEYFRAME)
+        {
+            res.push_back(ToNano(entry.timestamp - startTime, stream.timeBase, AV_ROUND_ZERO));
+        }
+    }
+
+    return res;
+}
+
 VideoStream OpenMediaSource(ReaderFactory readerFactory,
                             OpeningParams params)
 {
+    auto [activeCtx, stream] = CreateMediaContext(readerFactory(), params);
 
-    using namespace std::ranges::views;
-
-    auto [activeCtx, stream] = CreateMediaContext(readerFactory(), params.picker, params.skipNonRef);
+    //Seeking context is created from the same content, so probing results
+    //of active one are reused
+    if(!params.probed)
+    {
+        params.probed = MakeProbedMedia(*activeCtx->formatCtx, *stream);
+    }
 
-    auto picker =
-        [&stream](auto)
+    auto seekingCtxFactory =
+        [readerFactory = std::move(readerFactory), params = std::move(params)]()
         {
-            return IntCast<std::size_t>(stream->index);
+            return CreateMediaContext(readerFactory(), params).first;
         };
-    auto [seekingCtx, unused] = CreateMediaContext(readerFactory(), picker, params.skipNonRef);
 
-    return VideoStream{std::move(activeCtx), std::move(seekingCtx), *stream};
+    return VideoStream{std::move(activeCtx), std::move(seekingCtxFactory), *stream};
 }
 
 
 
 VideoStream::VideoStream(std::unique_ptr<MediaContext> activeContext,
-                         std::unique_ptr<MediaContext> seekingContext,
+                         ContextFactory seekingContextFactory,
                          AVStream &stream)
     : mActiveCtx(std::move(activeContext)),
-      mSeekingCtx(std::move(seekingContext)),
+      mSeekingCtxFactory(std::move(seekingContextFactory)),
       mStream(stream)
 {
 
@@ -267,6 +380,19 @@ std::shared_ptr<AVFrame> VideoStream::SeekAndReturnFrame(Nanoseconds timestamp)
     } else {
         AssertPtsIsSet(*mLastReturnedFrame);
 
+        if(IsReachableByDecoding(startTime + target))
+        {
+            mFramesQueue.push_front(std::move(mLastReturnedFrame));
+            auto frame = TakeFrame(*mActiveCtx);
+
+            return DropFramesUntilTimestamp(std::move(frame), target);
+        }
+
+        if(!mSeekingCtx)
+        {
+            mSeekingCtx = mSeekingCtxFactory();
+        }
+
         auto frame = SeekAndTakeFrame(*mSeekingCtx, stream.index, startTime, startTime + target);
 
         if(!frame)
@@ -305,6 +431,33 @@ std::shared_ptr<AVFrame> VideoStream::SeekAndReturnFrame(Nanoseconds timestamp)
     }
 }
 
+bool VideoStream::IsReachableByDecoding(std::int64_t timestamp) const
+{
+    auto lastPts = mLastReturnedFrame->pts;
+    if(lastPts > timestamp)
+    {
+        return false;
+    }
+
+    //Demuxers with generic index (e.g. MPEG-TS) know only keyframes of
+    //packets they've read, so keyframe may be missing between them
+    auto &formatCtx = *mActiveCtx->formatCtx;
+    auto &stream = *formatCtx.streams[mStream.get().index];
+    auto numEntries = avformat_index_get_entries_count(&stream);
+    if(numEntries == 0 ||
+       ((formatCtx.iformat->flags & AVFMT_GENERIC_INDEX) != 0 &&
+        avformat_index_get_entry(&stream, numEntries - 1)->timestamp < timestamp))
+    {
+        return false;
+    }
+
+    //Closest keyframe at or before timestamp
+    const auto *entry = avformat_index_get_entry_from_timestamp(&stream,
+                                                                timestamp,
+                                                                AVSEEK_FLAG_BACKWARD);
+    return entry != nullptr && entry->timestamp < lastPts;
+}
+
 std::shared_ptr<AVFrame>
     VideoStream::DropFramesUntilTimestamp(std::shared_ptr<AVFrame> frame,
                                           std::int64_t target)
@@ -391,13 +544,155 @@ UniquePtr<AVIOContext> CreateIoContext(Reader *reader, int bufferSize)
                          &Reader::Seek);
 }
 
-UniquePtr<AVFormatContext> CreateFormatContext(AVIOContext *ioCtx)
+void SetExtradata(AVCodecParameters &par, std::span<const std::byte> data)
+{
+    //Decoders expect zeroed padding behind extradata
+    auto *extradata = static_cast<std::uint8_t *>(av_mallocz(data.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+    if(!extradata)
+    {
+        throw Error{"failed to allocate extradata"};
+    }
+    std::memcpy(extradata, data.data(), data.size());
+
+    av_freep(&par.extradata);
+    par.extradata = extradata;
+    par.extradata_size = IntCast<int>(data.size());
+}
+
+//Fields which are left equal to defaults by opening are taken from probed
+//parameters. Others are kept, because probed ones may be loaded from file,
+//which keeps only some of them
+void FillUnsetCodecParameters(AVCodecParameters &par, const AVCodecParameters &probed)
+{
+    const auto defaults = MakeCodecParameters();
+    auto fill =
+        [&par, &probed, &defaults](auto member)
+        {
+            if(par.*member == (*defaults).*member)
+            {
+                par.*member = probed.*member;
+            }
+        };
+
+    fill(&AVCodecParameters::codec_tag);
+    fill(&AVCodecParameters::format);
+    fill(&AVCodecParameters::bit_rate);
+    fill(&AVCodecParameters::bits_per_coded_sample);
+    fill(&AVCodecParameters::bits_per_raw_sample);
+    fill(&AVCodecParameters::profile);
+    fill(&AVCodecParameters::level);
+    fill(&AVCodecParameters::width);
+    fill(&AVCodecParameters::height);
+    fill(&AVCodecParameters::field_order);
+    fill(&AVCodecParameters::color_range);
+    fill(&AVCodecParameters::color_primaries);
+    fill(&AVCodecParameters::color_trc);
+    fill(&AVCodecParameters::color_space);
+    fill(&AVCodecParameters::chroma_location);
+    fill(&AVCodecParameters::video_delay);
+    fill(&AVCodecParameters::sample_rate);
+    fill(&AVCodecParameters::block_align);
+    fill(&AVCodecParameters::frame_size);
+
+    if(par.sample_aspect_ratio.num == 0)
+    {
+        par.sample_aspect_ratio = probed.sample_aspect_ratio;
+    }
+
+    if(par.extradata_size == 0 && probed.extradata_size > 0)
+    {
+        SetExtradata(par, std::as_bytes(std::span{probed.extradata, IntCast<std::size_t>(probed.extradata_size)}));
+    }
+
+    if(par.ch_layout.nb_channels == 0)
+    {
+        if(auto err = av_channel_layout_copy(&par.ch_layout, &probed.ch_layout); err < 0)
+        {
+            throw LibraryCallError{"av_channel_layout_copy", err};
+        }
+    }
+}
+
+//Returns false if streams don't match probed ones, nothing is changed then
+bool ApplyProbedMedia(AVFormatContext &ctx, const ProbedMedia &probed)
+{
+    if(ctx.nb_streams != probed.streams.size())
+    {
+        return false;
+    }
+
+    auto streams = std::span(ctx.streams, ctx.nb_streams);
+    for(std::size_t i = 0; i < streams.size(); ++i)
+    {
+        if(streams[i]->codecpar->codec_id != probed.streams[i].codecpar->codec_id ||
+           av_cmp_q(streams[i]->time_base, probed.streams[i].timeBase) != 0)
+        {
+            return false;
+        }
+    }
+
+    for(std::size_t i = 0; i < streams.size(); ++i)
+    {
+        auto &stream = *streams[i];
+        const auto &info = probed.streams[i];
+
+        FillUnsetCodecParameters(*stream.codecpar, *info.codecpar);
+
+        if(stream.start_time == AV_NOPTS_VALUE)
+        {
+            stream.start_time = info.startTime;
+        }
+        if(stream.duration == AV_NOPTS_VALUE)
+        {
+            stream.duration = info.duration;
+        }
+        if(stream.avg_frame_rate.num == 0)
+        {
+            stream.avg_frame_rate = info.avgFrameRate;
+        }
+        if(stream.r_frame_rate.num == 0)
+        {
+            stream.r_frame_rate = info.rFrameRate;
+        }
+    }
+
+    if(ctx.duration == AV_NOPTS_VALUE)
+    {
+        ctx.duration = probed.duration;
+    }
+
+    //Demuxers reading index lazily (e.g. from Cues of Matroska) get it
+    //without reading it again
+    auto &picked = *streams[IntCast<std::size_t>(probed.streamIndex)];
+    if(std::cmp_less(avformat_index_get_entries_count(&picked), probed.index.size()))
+    {
+        for(const auto &entry : probed.index)
+        {
+            if(auto err = av_add_index_entry(&picked,
+                                             entry.pos,
+                                             entry.timestamp,
+                                             entry.size,
+                                             entry.distance,
+                                             entry.flags);
+               err < 0)
+            {
+                throw LibraryCallError{"av_add_index_entry", err};
+            }
+        }
+    }
+
+    return true;
+}
+
+//If media was probed already, format isn't detected again and streams
+//aren't analyzed unless they turn out to differ
+UniquePtr<AVFormatContext> CreateFormatContext(AVIOContext *ioCtx, const ProbedMedia *probed)
 {
     auto res = MakeFormatContext();
     res->pb = ioCtx;
 
     AVFormatContext *tmp = res.get();
-    if(int err = avformat_open_input(&tmp, nullptr, nullptr, nullptr); err < 0)
+    if(int err = avformat_open_input(&tmp, nullptr, probed ? probed->format : nullptr, nullptr); err < 0)
     {
         //avformat_open_input frees context on failure, so we have to release to
         //avoid double deletion
@@ -405,6 +700,11 @@ UniquePtr<AVFormatContext> CreateFormatContext(AVIOContext *ioCtx)
         throw LibraryCallError{"avformat_open_input", err};
     }
 
+    if(probed && ApplyProbedMedia(*res, *probed))
+    {
+        return res;
+    }
+
     if(int err = avformat_find_stream_info(res.get(), nullptr); err < 0)
     {
         throw LibraryCallError{"avformat_find_stream_info", err};
@@ -437,15 +737,34 @@ AVStream &PickStream(AVFormatContext &ctx, const StreamPicker &picker)
     return *streams[index];
 }
 
-UniquePtr<AVCodecContext> CreateCodecContext(const AVStream &stream)
+const AVCodec *FindDecoder(AVCodecID codecId, const std::string &name)
 {
-    auto codec = avcodec_find_decoder(stream.codecpar->codec_id);
-    if(codec == nullptr)
+    if(name.empty())
+    {
+        auto codec = avcodec_find_decoder(codecId);
+        if(codec == nullptr)
+        {
+            throw Error{Format(R"(can't find decoder for codec "{}")",
+                               std::string(avcodec_get_name(codecId)))};
+        }
+
+        return codec;
+    }
+
+    auto codec = avcodec_find_decoder_by_name(name.c_str());
+    if(codec == nullptr || !av_codec_is_decoder(codec) || codec->id != codecId)
     {
-        throw Error{Format(R"(can't find decoder for codec "{}")",
-                           std::string(avcodec_get_name(stream.codecpar->codec_id)))};
+        throw NotFoundError{Format(R"(can't find decoder "{}" for codec "{}")",
+                                   name,
+                                   std::string(avcodec_get_name(codecId)))};
     }
 
+    return codec;
+}
+
+UniquePtr<AVCodecContext> CreateCodecContext(const AVStream &stream, const OpeningParams &params)
+{
+    auto codec = FindDecoder(stream.codecpar->codec_id, params.decoderName);
     auto res = MakeCodecContext(codec);
 
     if(auto err = avcodec_parameters_to_context(res.get(), stream.codecpar); err < 0)
@@ -453,6 +772,11 @@ UniquePtr<AVCodecContext> CreateCodecContext(const AVStream &stream)
         throw LibraryCallError{"avcodec_parameters_to_context", err};
     }
 
+    //Frame threading delays output by a frame per thread, which doesn't
+    //matter since frames are decoded ahead of returned ones anyway
+    res->thread_count = IntCast<int>(params.decoderThreads);
+    res->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
     if(auto err = avcodec_open2(res.get(), res->codec, nullptr); err != 0)
     {
         throw LibraryCallError{"avcodec_open2", err};
@@ -462,10 +786,9 @@ UniquePtr<AVCodecContext> CreateCodecContext(const AVStream &stream)
 }
 
 std::pair<std::unique_ptr<MediaContext>, AVStream *>
-    CreateMediaContext(std::unique_ptr<Reader> &&reader,
-                       const StreamPicker &picker,
-                       bool skipNonRef)
+    CreateMediaContext(std::unique_ptr<Reader> &&reader, const OpeningParams &params)
 {
+    const auto *probed = params.probed.get();
     static const int bufferSize = 1 < 15;
 
     if(!reader)
@@ -477,9 +800,15 @@ std::pair<std::unique_ptr<MediaContext>, AVStream *>
     ctx->reader = std::move(reader);
 
     ctx->ioCtx = CreateIoContext(ctx->reader.get(), bufferSize);
-    ctx->formatCtx = CreateFormatContext(ctx->ioCtx.get());
+    ctx->formatCtx = CreateFormatContext(ctx->ioCtx.get(), probed);
+
+    if(probed && std::cmp_greater_equal(probed->streamIndex, ctx->formatCtx->nb_streams))
+    {
+        throw NotFoundError{"probed stream isn't found in media source"};
+    }
 
-    auto &stream = PickStream(*ctx->formatCtx, picker);
+    auto &stream = probed ? *ctx->formatCtx->streams[probed->streamIndex]
+                          : PickStream(*ctx->formatCtx, params.picker);
     for(auto s : std::span(ctx->formatCtx->streams, ctx->formatCtx->nb_streams))
     {
         if(s->index != stream.index)
@@ -488,8 +817,8 @@ std::pair<std::unique_ptr<MediaContext>, AVStream *>
         }
     }
 
-    ctx->codecCtx = CreateCodecContext(stream);
-    if(skipNonRef)
+    ctx->codecCtx = CreateCodecContext(stream, params);
+    if(params.skipNonRef)
     {
         ctx->codecCtx->skip_frame = AVDISCARD_NONREF;
     }
@@ -500,6 +829,279 @@ std::pair<std::unique_ptr<MediaContext>, AVStream *>
     return {std::move(ctx), &stream};
 }
 
+std::shared_ptr<const ProbedMedia> MakeProbedMedia(const AVFormatContext &ctx, AVStream &stream)
+{
+    auto res = std::make_shared<ProbedMedia>();
+    res->format = ctx.iformat;
+    res->duration = ctx.duration;
+    res->streamIndex = stream.index;
+
+    res->streams.reserve(ctx.nb_streams);
+    for(auto s : std::span(ctx.streams, ctx.nb_streams))
+    {
+        res->streams.push_back(ProbedMedia::Stream{.codecpar = MakeCodecParameters(s->codecpar),
+                                                   .timeBase = s->time_base,
+                                                   .startTime = s->start_time,
+                                                   .duration = s->duration,
+                                                   .avgFrameRate = s->avg_frame_rate,
+                                                   .rFrameRate = s->r_frame_rate});
+    }
+
+    auto numEntries = avformat_index_get_entries_count(&stream);
+    res->index.reserve(IntCast<std::size_t>(numEntries));
+    for(int i = 0; i < numEntries; ++i)
+    {
+        const auto *entry = avformat_index_get_entry(&stream, i);
+        res->index.push_back(ProbedMedia::IndexEntry{.pos = entry->pos,
+                                                     .timestamp = entry->timestamp,
+                                                     .size = entry->size,
+                                                     .distance = entry->min_distance,
+                                                     .flags = entry->flags});
+    }
+
+    return res;
+}
+
+//"VDPM" in little endian
+const std::uint32_t cProbedMediaMagic = 0x4d504456;
+const std::uint32_t cProbedMediaVersion = 1;
+
+//Integers are stored in little endian, byte strings are prefixed by size
+class BinaryWriter final
+{
+public:
+    template <std::integral T>
+    void Write(T val)
+    {
+        val = EndianCastTo<std::endian::little>(val);
+        auto bytes = std::as_bytes(std::span{&val, 1});
+        mData.insert(mData.end(), bytes.begin(), bytes.end());
+    }
+
+    void Write(AVRational val)
+    {
+        Write<std::int32_t>(val.num);
+        Write<std::int32_t>(val.den);
+    }
+
+    void Write(std::span<const std::byte> bytes)
+    {
+        Write(IntCast<std::uint32_t>(bytes.size()));
+        mData.insert(mData.end(), bytes.begin(), bytes.end());
+    }
+
+    std::vector<std::byte> Release() noexcept
+    {
+        return std::move(mData);
+    }
+
+private:
+    std::vector<std::byte> mData;
+};
+
+class BinaryReader final
+{
+public:
+    explicit BinaryReader(std::span<const std::byte> data)
+        : mData{data}
+    {}
+
+    template <std::integral T>
+    T Read()
+    {
+        T val;
+        std::memcpy(&val, Take(sizeof val).data(), sizeof val);
+        return EndianCastFrom<std::endian::little>(val);
+    }
+
+    AVRational ReadRational()
+    {
+        auto num = Read<std::int32_t>();
+        auto den = Read<std::int32_t>();
+        return AVRational{num, den};
+    }
+
+    std::span<const std::byte> ReadBytes()
+    {
+        return Take(Read<std::uint32_t>());
+    }
+
+    bool IsEmpty() const noexcept
+    {
+        return mData.empty();
+    }
+
+private:
+    std::span<const std::byte> mData;
+
+    std::span<const std::byte> Take(std::size_t size)
+    {
+        if(size > mData.size())
+        {
+            throw Error{"unexpected end of data"};
+        }
+
+        auto res = mData.first(size);
+        mData = mData.subspan(size);
+        return res;
+    }
+};
+
+//Only parameters used by decoders and demuxers are kept
+void WriteCodecParameters(BinaryWriter &writer, const AVCodecParameters &par)
+{
+    writer.Write<std::int32_t>(par.codec_type);
+    writer.Write<std::int32_t>(par.codec_id);
+    writer.Write<std::uint32_t>(par.codec_tag);
+    writer.Write(std::as_bytes(std::span{par.extradata, IntCast<std::size_t>(par.extradata_size)}));
+    writer.Write<std::int32_t>(par.format);
+    writer.Write<std::int64_t>(par.bit_rate);
+    writer.Write<std::int32_t>(par.bits_per_coded_sample);
+    writer.Write<std::int32_t>(par.bits_per_raw_sample);
+    writer.Write<std::int32_t>(par.profile);
+    writer.Write<std::int32_t>(par.level);
+    writer.Write<std::int32_t>(par.width);
+    writer.Write<std::int32_t>(par.height);
+    writer.Write(par.sample_aspect_ratio);
+    writer.Write<std::int32_t>(par.field_order);
+    writer.Write<std::int32_t>(par.color_range);
+    writer.Write<std::int32_t>(par.color_primaries);
+    writer.Write<std::int32_t>(par.color_trc);
+    writer.Write<std::int32_t>(par.color_space);
+    writer.Write<std::int32_t>(par.chroma_location);
+    writer.Write<std::int32_t>(par.video_delay);
+    writer.Write<std::int32_t>(par.ch_layout.nb_channels);
+    writer.Write<std::int32_t>(par.sample_rate);
+    writer.Write<std::int32_t>(par.block_align);
+    writer.Write<std::int32_t>(par.frame_size);
+}
+
+UniquePtr<AVCodecParameters> ReadCodecParameters(BinaryReader &reader)
+{
+    auto res = MakeCodecParameters();
+    res->codec_type = static_cast<AVMediaType>(reader.Read<std::int32_t>());
+    res->codec_id = static_cast<AVCodecID>(reader.Read<std::int32_t>());
+    res->codec_tag = reader.Read<std::uint32_t>();
+
+    if(auto extradata = reader.ReadBytes(); !extradata.empty())
+    {
+        SetExtradata(*res, extradata);
+    }
+
+    res->format = reader.Read<std::int32_t>();
+    res->bit_rate = reader.Read<std::int64_t>();
+    res->bits_per_coded_sample = reader.Read<std::int32_t>();
+    res->bits_per_raw_sample = reader.Read<std::int32_t>();
+    res->profile = reader.Read<std::int32_t>();
+    res->level = reader.Read<std::int32_t>();
+    res->width = reader.Read<std::int32_t>();
+    res->height = reader.Read<std::int32_t>();
+    res->sample_aspect_ratio = reader.ReadRational();
+    res->field_order = static_cast<AVFieldOrder>(reader.Read<std::int32_t>());
+    res->color_range = static_cast<AVColorRange>(reader.Read<std::int32_t>());
+    res->color_primaries = static_cast<AVColorPrimaries>(reader.Read<std::int32_t>());
+    res->color_trc = static_cast<AVColorTransferCharacteristic>(reader.Read<std::int32_t>());
+    res->color_space = static_cast<AVColorSpace>(reader.Read<std::int32_t>());
+    res->chroma_location = static_cast<AVChromaLocation>(reader.Read<std::int32_t>());
+    res->video_delay = reader.Read<std::int32_t>();
+    //Channel order isn't needed by discarded streams
+    res->ch_layout.nb_channels = reader.Read<std::int32_t>();
+    res->sample_rate = reader.Read<std::int32_t>();
+    res->block_align = reader.Read<std::int32_t>();
+    res->frame_size = reader.Read<std::int32_t>();
+
+    return res;
+}
+
+std::vector<std::byte> SerializeProbedMedia(const ProbedMedia &probed)
+{
+    auto writer = BinaryWriter{};
+    writer.Write(cProbedMediaMagic);
+    writer.Write(cProbedMediaVersion);
+    writer.Write<std::uint32_t>(avformat_version());
+    writer.Write(std::as_bytes(std::span{std::string_view{probed.format->name}}));
+    writer.Write<std::int64_t>(probed.duration);
+    writer.Write<std::int32_t>(probed.streamIndex);
+
+    writer.Write(IntCast<std::uint32_t>(probed.streams.size()));
+    for(const auto &stream : probed.streams)
+    {
+        WriteCodecParameters(writer, *stream.codecpar);
+        writer.Write(stream.timeBase);
+        writer.Write<std::int64_t>(stream.startTime);
+        writer.Write<std::int64_t>(stream.duration);
+        writer.Write(stream.avgFrameRate);
+        writer.Write(stream.rFrameRate);
+    }
+
+    writer.Write(IntCast<std::uint32_t>(probed.index.size()));
+    for(const auto &entry : probed.index)
+    {
+        writer.Write<std::int64_t>(entry.pos);
+        writer.Write<std::int64_t>(entry.timestamp);
+        writer.Write<std::int32_t>(entry.size);
+        writer.Write<std::int32_t>(entry.distance);
+        writer.Write<std::int32_t>(entry.flags);
+    }
+
+    return writer.Release();
+}
+
+std::shared_ptr<const ProbedMedia> ParseProbedMedia(std::span<const std::byte> data)
+{
+    auto reader = BinaryReader{data};
+    if(reader.Read<std::uint32_t>() != cProbedMediaMagic ||
+       reader.Read<std::uint32_t>() != cProbedMediaVersion ||
+       reader.Read<std::uint32_t>() != avformat_version())
+    {
+        throw Error{"probed media is stored in unsupported format"};
+    }
+
+    auto res = std::make_shared<ProbedMedia>();
+
+    auto name = reader.ReadBytes();
+    res->format = av_find_input_format(std::string(reinterpret_cast<const char *>(name.data()), name.size()).c_str());
+    if(res->format == nullptr)
+    {
+        throw NotFoundError{"input format of probed media isn't found"};
+    }
+
+    res->duration = reader.Read<std::int64_t>();
+    res->streamIndex = reader.Read<std::int32_t>();
+
+    //Fields are initialized in order of declaration, so data is read in order
+    auto numStreams = reader.Read<std::uint32_t>();
+    for(std::uint32_t i = 0; i < numStreams; ++i)
+    {
+        res->streams.push_back(ProbedMedia::Stream{.codecpar = ReadCodecParameters(reader),
+                                                   .timeBase = reader.ReadRational(),
+                                                   .startTime = reader.Read<std::int64_t>(),
+                                                   .duration = reader.Read<std::int64_t>(),
+                                                   .avgFrameRate = reader.ReadRational(),
+                                                   .rFrameRate = reader.ReadRational()});
+    }
+
+    auto numEntries = reader.Read<std::uint32_t>();
+    for(std::uint32_t i = 0; i < numEntries; ++i)
+    {
+        res->index.push_back(ProbedMedia::IndexEntry{.pos = reader.Read<std::int64_t>(),
+                                                     .timestamp = reader.Read<std::int64_t>(),
+                                                     .size = reader.Read<std::int32_t>(),
+                                                     .distance = reader.Read<std::int32_t>(),
+                                                     .flags = reader.Read<std::int32_t>()});
+    }
+
+    if(!reader.IsEmpty() ||
+       res->streamIndex < 0 ||
+       std::cmp_greater_equal(res->streamIndex, res->streams.size()) ||
+       res->streams[IntCast<std::size_t>(res->streamIndex)].codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+    {
+        throw Error{"probed media is malformed"};
+    }
+
+    return res;
+}
+
 void AssertPtsIsSet(const AVFrame &frame)
 {
     if(frame.pts == AV_NOPTS_VALUE)
@@ -44,6 +44,7 @@ private:
 
 
 class VideoStream;
+struct ProbedMedia;
 using StreamPicker = std::function<std::size_t(std::span<const AVStream * const>)>;
 using ReaderFactory = std::function<std::unique_ptr<libav::Reader>()>;
 
@@ -51,8 +52,34 @@ struct OpeningParams final
 {
     StreamPicker picker = [](auto) { return 0; };
     bool skipNonRef{false};
+    //If given, media isn't probed again and stream picked during probing is
+    //opened, so picker is ignored
+    std::shared_ptr<const ProbedMedia> probed;
+    //Frame and slice threading of decoder, 0 lets libavcodec choose by number
+    //of cores
+    std::size_t decoderThreads{1};
+    //Alternative implementation of codec (e.g. "libdav1d"), default decoder
+    //is used if empty
+    std::string decoderName;
 };
 
+//Result is immutable, so it may be shared by streams opened from the same
+//content in different threads. It contains stream parameters and demuxer
+//index of picked stream
+std::shared_ptr<const ProbedMedia> ProbeMediaSource(ReaderFactory readerFactory,
+                                                    const StreamPicker &picker = [](auto) { return 0; });
+//Probing results are persisted, so later runs open the same content without
+//analyzing streams and reading index again. File is tied to libavformat
+//version, load returns nullptr if file is missing, malformed or outdated.
+//Only codec parameters needed by decoders are kept, they complete those
+//which demuxer reads on opening and never replace them
+void SaveProbedMedia(const std::filesystem::path &path, const ProbedMedia &probed);
+std::shared_ptr<const ProbedMedia> LoadProbedMedia(const std::filesystem::path &path);
+//Timestamps are relative to start of stream like ones passed to NextFrame,
+//they are sorted. Empty if demuxer has no index
+std::vector<Nanoseconds> GetKeyframeTimestamps(const ProbedMedia &probed);
+//Factory is kept by stream to open second context on first seek which
+//can't be served by decoding further, so it must own everything it captures
 VideoStream OpenMediaSource(ReaderFactory readerFactory,
                             OpeningParams params = OpeningParams{});
 
@@ -66,8 +93,10 @@ class VideoStream final
                                        OpeningParams params);
 
 private:
+    using ContextFactory = std::function<std::unique_ptr<MediaContext>()>;
+
     VideoStream(std::unique_ptr<MediaContext> activeContext,
-                std::unique_ptr<MediaContext> seekingContext,
+                ContextFactory seekingContextFactory,
                 AVStream &stream);
 
 public:
@@ -81,7 +110,9 @@ public:
 
 private:
     std::unique_ptr<MediaContext> mActiveCtx;
+    //Created on first seek which can't be served by decoding further
     std::unique_ptr<MediaContext> mSeekingCtx;
+    ContextFactory mSeekingCtxFactory;
     std::reference_wrapper<AVStream> mStream;
     std::shared_ptr<AVFrame> mLastReturnedFrame;
     std::deque<std::shared_ptr<AVFrame>> mFramesQueue;
@@ -94,6 +125,10 @@ private:
 
     std::shared_ptr<AVFrame> ReturnFrame();
     std::shared_ptr<AVFrame> SeekAndReturnFrame(Nanoseconds timestamp);
+    //Returns true if index shows that no keyframe lies between last returned
+    //frame and timestamp, so seeking can't be faster than decoding. Index
+    //built from packets read so far is trusted only if it reaches timestamp
+    bool IsReachableByDecoding(std::int64_t timestamp) const;
     std::shared_ptr<AVFrame> DropFramesUntilTimestamp(std::shared_ptr<AVFrame> frame,
                                                       std::int64_t target);
 };
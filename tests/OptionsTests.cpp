@@ -79,10 +79,12 @@ TEST(OptionsTests, Threads)
     ASSERT_THROW(Parse(argv), Error);
 
     argv[2] = "256";
-    ASSERT_THROW(Parse(argv), Error);
+    auto options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_EQ(256, options->numThreads);
 
     argv[2] = "2";
-    auto options = Parse(argv);
+    options = Parse(argv);
     ASSERT_TRUE(options);
     ASSERT_EQ(2, options->numThreads);
 
@@ -104,6 +106,87 @@ TEST(OptionsTests, Threads)
     }
 }
 
+TEST(OptionsTests, Decoder)
+{
+    auto argv = std::array{"app_path", "url", "1s500ms-2s300ms:22"};
+    auto options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_EQ(0, options->decoderThreads);
+    ASSERT_TRUE(options->decoder.empty());
+
+    auto argv2 = std::array{"app_path", "--decoder-threads", "-1", "--decoder", "hevc", "url", "1s500ms-2s300ms:22"};
+    ASSERT_THROW(Parse(argv2), Error);
+
+    argv2[2] = "8";
+    options = Parse(argv2);
+    ASSERT_TRUE(options);
+    ASSERT_EQ(8, options->decoderThreads);
+    ASSERT_EQ("hevc", options->decoder);
+}
+
+TEST(OptionsTests, Connections)
+{
+    auto argv = std::array{"app_path", "-t", "4", "-n", "-1", "url", "1s500ms-2s300ms:22"};
+    ASSERT_THROW(Parse(argv), Error);
+
+    argv[4] = "8";
+    auto options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_EQ(8, options->numConnections);
+
+    argv[4] = "0";
+    options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_EQ(4, options->numConnections);
+}
+
+TEST(OptionsTests, Memory)
+{
+    auto argv = std::array{"app_path", "-m", "-1", "url", "1s500ms-2s300ms:22"};
+    ASSERT_THROW(Parse(argv), Error);
+
+    argv[2] = "64";
+    auto options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_EQ(std::size_t{64} << 20, options->memoryLimit);
+
+    argv[2] = "0";
+    options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_EQ(0, options->memoryLimit);
+}
+
+TEST(OptionsTests, DiskCache)
+{
+    auto argv = std::array{"app_path", "url", "1s500ms-2s300ms:22"};
+    auto options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_TRUE(options->cacheDir.empty());
+    ASSERT_EQ(std::size_t{1024} << 20, options->cacheSize);
+
+    auto argv2 = std::array{"app_path", "--cache-dir", "dir", "--cache-size", "-1", "url", "1s500ms-2s300ms:22"};
+    ASSERT_THROW(Parse(argv2), Error);
+
+    argv2[4] = "16";
+    options = Parse(argv2);
+    ASSERT_TRUE(options);
+    ASSERT_EQ("dir", options->cacheDir);
+    ASSERT_EQ(std::size_t{16} << 20, options->cacheSize);
+}
+
+TEST(OptionsTests, Stats)
+{
+    auto argv = std::array{"app_path", "url", "1s500ms-2s300ms:22"};
+    auto options = Parse(argv);
+    ASSERT_TRUE(options);
+    ASSERT_FALSE(options->printStats);
+
+    auto argv2 = std::array{"app_path", "--stats", "url", "1s500ms-2s300ms:22"};
+    options = Parse(argv2);
+    ASSERT_TRUE(options);
+    ASSERT_TRUE(options->printStats);
+}
+
 TEST(OptionsTests, CorrectSegmentFull)
 {
     auto argv = std::array{"app_path", "-f", "some_format", "url", "1s500ms-2s300ms:22"};
@@ -0,0 +1,91 @@
+#include <vd/Planning.h>
+#include <vd/Errors.h>
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+using namespace vd;
+
+namespace
+{
+
+TEST(PlanningTests, SegmentTargetsAreEvenlySpaced)
+{
+    auto targets = MakeSegmentTargets(Options::Segment{.from = 1s, .to = 4s, .numFrames = 2}, 3);
+
+    ASSERT_EQ(4, targets.size());
+    for(std::size_t i = 0; i < targets.size(); ++i)
+    {
+        ASSERT_EQ(1s + 1s*i, targets[i].timestamp);
+        ASSERT_EQ(3, targets[i].segIdx);
+        ASSERT_EQ(i, targets[i].frameIdx);
+    }
+
+    ASSERT_THROW(MakeSegmentTargets(Options::Segment{.from = 0ns, .to = 2ns, .numFrames = 2}, 0), Error);
+}
+
+TEST(PlanningTests, SharedGopIsDecodedOnce)
+{
+    auto segments = std::vector<Options::Segment>{{.from = 1s, .to = 7s, .numFrames = 1},
+                                                  {.from = 3s, .to = 5s, .numFrames = 1}};
+    auto keyframes = std::vector<Nanoseconds>{2s, 4s, 6s};
+
+    auto tasks = PlanDecoding(segments, keyframes);
+
+    //Timestamps are 1s, 3s, 4s, 4s, 5s, 7s
+    ASSERT_EQ(4, tasks.size());
+    ASSERT_EQ(0ns, tasks[0].keyframe);
+    ASSERT_EQ(1, tasks[0].targets.size());
+    ASSERT_EQ(2s, tasks[1].keyframe);
+    ASSERT_EQ(1, tasks[1].targets.size());
+    ASSERT_EQ(4s, tasks[2].keyframe);
+    ASSERT_EQ(3, tasks[2].targets.size());
+    ASSERT_EQ(6s, tasks[3].keyframe);
+
+    //Both segments request frame at 4s
+    const auto &shared = tasks[2].targets;
+    ASSERT_EQ(4s, shared[0].timestamp);
+    ASSERT_EQ(0, shared[0].segIdx);
+    ASSERT_EQ(1, shared[0].frameIdx);
+    ASSERT_EQ(4s, shared[1].timestamp);
+    ASSERT_EQ(1, shared[1].segIdx);
+    ASSERT_EQ(1, shared[1].frameIdx);
+
+    //Segments are decoded independently without keyframes
+    tasks = PlanDecoding(segments, {});
+    ASSERT_EQ(2, tasks.size());
+    ASSERT_EQ(3, tasks[0].targets.size());
+    ASSERT_EQ(3, tasks[1].targets.size());
+}
+
+TEST(PlanningTests, LongSegmentIsSplitWithoutKeyframes)
+{
+    auto segments = std::vector<Options::Segment>{{.from = 0s, .to = 3600s, .numFrames = 3598},
+                                                  {.from = 0s, .to = 1s, .numFrames = 0}};
+
+    auto tasks = PlanDecoding(segments, {}, 4);
+
+    //Short segment still gets its own task
+    ASSERT_EQ(5, tasks.size());
+    auto frameIdx = std::size_t{0};
+    for(std::size_t i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ(900, tasks[i].targets.size());
+        for(const auto &target : tasks[i].targets)
+        {
+            ASSERT_EQ(0, target.segIdx);
+            ASSERT_EQ(frameIdx++, target.frameIdx);
+        }
+    }
+    ASSERT_EQ(2, tasks[4].targets.size());
+}
+
+TEST(PlanningTests, DecodersGetCoresLeftByWorkers)
+{
+    ASSERT_EQ(64, CalcDecoderThreads(1, 64));
+    ASSERT_EQ(16, CalcDecoderThreads(4, 64));
+    ASSERT_EQ(1, CalcDecoderThreads(65, 64));
+    ASSERT_EQ(1, CalcDecoderThreads(0, 1));
+}
+
+}//unnamed namespace
@@ -5,8 +5,12 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <cstdio>
+#include <fstream>
+#include <functional>
 #include <future>
+#include <latch>
 #include <regex>
 #include <thread>
 
@@ -39,6 +43,10 @@ const std::string gContentPath = "/content";
 const std::string gUrl = gAddress + gContentPath;
 const std::string gRangesContentPath = "/content_ranges";
 const std::string gUrlRanges = gAddress + gRangesContentPath;
+const std::string gTruncatedContentPath = "/content_truncated";
+const std::string gUrlTruncated = gAddress + gTruncatedContentPath;
+const std::string gStalledContentPath = "/content_stalled";
+const std::string gUrlStalled = gAddress + gStalledContentPath;
 auto gContentSpan = std::as_bytes(std::span<const char>{gContent.cbegin(), gContent.size()});
 auto gDefaultSource = MemoryViewSource{gContentSpan};
 
@@ -67,6 +75,163 @@ TEST(UrlParsingTests, PathAndQueryExtraction)
     ASSERT_EQ(std::string("/path?query#hash"), ExtractPathAndQuery("http://random.site.com:1234/path?query#hash"));
 }
 
+//Box header with 32-bit size (or 64-bit one if it doesn't fit)
+std::string MakeMp4Box(std::string_view type, std::uint64_t size)
+{
+    auto box = std::string{};
+    auto append =
+        [&box](std::uint64_t val, std::size_t numBytes)
+        {
+            for(auto i = numBytes; i > 0; --i)
+            {
+                box.push_back(static_cast<char>((val >> (8 * (i - 1))) & 0xFF));
+            }
+        };
+
+    if(size > std::numeric_limits<std::uint32_t>::max())
+    {
+        append(1, 4);
+        box += type;
+        append(size, 8);
+    }
+    else
+    {
+        append(size, 4);
+        box += type;
+    }
+
+    return box;
+}
+
+TEST(Mp4ProbingTests, MetadataAfterMediaData)
+{
+    auto ftyp = MakeMp4Box("ftyp", 16) + std::string(8, '\0');
+    auto head = ftyp + MakeMp4Box("mdat", 1000);
+    auto span = std::as_bytes(std::span{head});
+    ASSERT_EQ(std::size_t{1016}, FindTrailingMp4Metadata(span, 2000));
+    //Nothing follows media data
+    ASSERT_EQ(std::nullopt, FindTrailingMp4Metadata(span, 1016));
+
+    head = ftyp + MakeMp4Box("mdat", std::uint64_t{1} << 33);
+    span = std::as_bytes(std::span{head});
+    ASSERT_EQ((std::size_t{1} << 33) + 16, FindTrailingMp4Metadata(span, std::size_t{1} << 34));
+}
+
+TEST(Mp4ProbingTests, NoTrailingMetadata)
+{
+    auto ftyp = MakeMp4Box("ftyp", 16) + std::string(8, '\0');
+    auto faststart = ftyp + MakeMp4Box("moov", 100) + std::string(92, '\0') + MakeMp4Box("mdat", 1000);
+    ASSERT_EQ(std::nullopt, FindTrailingMp4Metadata(std::as_bytes(std::span{faststart}), 2000));
+
+    auto notMp4 = MakeMp4Box("abcd", 16) + std::string(8, '\0') + MakeMp4Box("mdat", 1000);
+    ASSERT_EQ(std::nullopt, FindTrailingMp4Metadata(std::as_bytes(std::span{notMp4}), 2000));
+
+    auto tooLong = ftyp + MakeMp4Box("mdat", 3000);
+    ASSERT_EQ(std::nullopt, FindTrailingMp4Metadata(std::as_bytes(std::span{tooLong}), 2000));
+}
+
+TEST(VectoredReadTests, AdjacentRequestsAreGrouped)
+{
+    auto buf = std::array<std::byte, 16>{};
+    auto span = std::span{buf};
+    auto requests = std::vector<ReadRequest>{{.pos = 8, .buf = span.subspan(8, 4)},
+                                             {.pos = 0, .buf = span.subspan(0, 4)},
+                                             {.pos = 4, .buf = span.subspan(4, 2)},
+                                             {.pos = 3, .buf = span.subspan(3, 0)},
+                                             {.pos = 12, .buf = span.subspan(12, 4)}};
+
+    auto groups = GroupAdjacent(requests);
+    ASSERT_EQ(2, groups.size());
+    ASSERT_EQ(0, groups[0].pos);
+    ASSERT_EQ(6, groups[0].size);
+    ASSERT_EQ(2, groups[0].requests.size());
+    ASSERT_EQ(8, groups[1].pos);
+    ASSERT_EQ(8, groups[1].size);
+    ASSERT_EQ(2, groups[1].requests.size());
+}
+
+TEST(VectoredReadTests, OverlapIsCopied)
+{
+    auto buf = std::string(6, '.');
+    auto span = std::as_writable_bytes(std::span{buf});
+    auto requests = std::vector<ReadRequest>{{.pos = 2, .buf = span.subspan(0, 3)},
+                                             {.pos = 8, .buf = span.subspan(3, 3)}};
+
+    CopyOverlap(3, std::as_bytes(std::span{std::string_view{"3456"}}), requests);
+    ASSERT_EQ(".34...", buf);
+}
+
+TEST(VectoredReadTests, ByteRangesBoundaryExtraction)
+{
+    ASSERT_EQ(std::nullopt, ExtractByteRangesBoundary("text/plain"));
+    ASSERT_EQ("abc", ExtractByteRangesBoundary("multipart/byteranges; boundary=abc"));
+    ASSERT_EQ("a b", ExtractByteRangesBoundary(R"(Multipart/ByteRanges;charset=x;boundary="a b")"));
+    ASSERT_THROW(ExtractByteRangesBoundary("multipart/byteranges"), Error);
+}
+
+TEST(VectoredReadTests, ContentRangeParsing)
+{
+    ASSERT_EQ(std::pair(std::size_t{2}, std::size_t{5}), ParseContentRange("bytes 2-5/10"));
+    ASSERT_EQ(std::pair(std::size_t{0}, std::size_t{0}), ParseContentRange(" bytes 0-0/*"));
+    ASSERT_THROW(ParseContentRange("bytes 5-2/10"), RangeError);
+    ASSERT_THROW(ParseContentRange("items 2-5/10"), Error);
+
+    ASSERT_EQ(std::size_t{10}, ParseContentRangeLength("bytes 2-5/10"));
+    ASSERT_EQ(std::nullopt, ParseContentRangeLength(" bytes 0-0/*"));
+    ASSERT_THROW(ParseContentRangeLength("bytes 2-5"), Error);
+}
+
+TEST(VectoredReadTests, ByteRangesParsing)
+{
+    auto body = std::string{"preamble\r\n"
+                            "--xyz\r\n"
+                            "Content-Type: text/plain\r\n"
+                            "Content-Range: bytes 0-3/27\r\n"
+                            "\r\n"
+                            "This\r\n"
+                            "--xyz\r\n"
+                            "Content-Range: bytes 8-14/27\r\n"
+                            "\r\n"
+                            "content\r\n"
+                            "--xyz--\r\n"};
+
+    //Parts must be the same however body is split into portions
+    for(std::size_t portion = 1; portion <= body.size(); ++portion)
+    {
+        auto parts = std::vector<std::pair<std::size_t, std::string>>{};
+        auto parser = ByteRangesParser{
+            "xyz",
+            [&parts](std::size_t pos, std::span<const std::byte> data)
+            {
+                auto str = std::string{reinterpret_cast<const char *>(data.data()), data.size()};
+                if(!parts.empty() && parts.back().first + parts.back().second.size() == pos)
+                {
+                    parts.back().second += str;
+                }
+                else
+                {
+                    parts.emplace_back(pos, str);
+                }
+            }};
+
+        for(std::size_t pos = 0; pos < body.size(); pos += portion)
+        {
+            parser.Feed(std::string_view{body}.substr(pos, portion));
+        }
+        parser.Finish();
+
+        auto expected = std::vector<std::pair<std::size_t, std::string>>{{0, "This"}, {8, "content"}};
+        ASSERT_EQ(expected, parts);
+    }
+
+    auto truncated = ByteRangesParser{"xyz", [](auto, auto) {}};
+    truncated.Feed(std::string_view{body}.substr(0, 60));
+    ASSERT_THROW(truncated.Finish(), Error);
+
+    auto noRange = ByteRangesParser{"xyz", [](auto, auto) {}};
+    ASSERT_THROW(noRange.Feed("--xyz\r\nContent-Type: text/plain\r\n\r\n"), Error);
+}
+
 
 
 class SourceBaseTestF : public ::testing::Test
@@ -74,6 +239,12 @@ class SourceBaseTestF : public ::testing::Test
 protected:
     httplib::Server mServer;
     std::future<void> mFuture;
+    //First request for stalled content starting from cStalledPos doesn't
+    //send body until released
+    static constexpr std::size_t cStalledPos = 1;
+    std::atomic<std::size_t> mNumStalledRequests{0};
+    std::promise<void> mRelease;
+    std::shared_future<void> mReleased{mRelease.get_future().share()};
 
     void SetUp() override
     {
@@ -100,6 +271,46 @@ protected:
                     res.set_content(gContent, gContentType);
                 });
 
+            mServer.Get(
+                gTruncatedContentPath,
+                [](const httplib::Request &, httplib::Response &res)
+                {
+                    res.set_header("Accept-Ranges", "bytes");
+                    //Connection is closed in the middle of every response
+                    //starting from beginning of content
+                    res.set_content_provider(
+                        gContent.size(),
+                        gContentType,
+                        [](std::size_t offset, std::size_t length, httplib::DataSink &sink)
+                        {
+                            auto len = offset == 0 ? length / 2 : length;
+                            sink.write(std::next(gContent.data(), offset), len);
+                            return len == length;
+                        });
+                });
+
+            mServer.Get(
+                gStalledContentPath,
+                [this](const httplib::Request &req, httplib::Response &res)
+                {
+                    res.set_header("Accept-Ranges", "bytes");
+                    auto isStalled =
+                        req.get_header_value("Range").starts_with("bytes=" + std::to_string(cStalledPos) + "-") &&
+                        mNumStalledRequests.fetch_add(1) == 0;
+                    res.set_content_provider(
+                        gContent.size(),
+                        gContentType,
+                        [this, isStalled](std::size_t offset, std::size_t length, httplib::DataSink &sink)
+                        {
+                            if(isStalled)
+                            {
+                                mReleased.wait_for(10s);
+                            }
+                            sink.write(std::next(gContent.data(), offset), length);
+                            return true;
+                        });
+                });
+
             if(!mServer.listen(gHostname, gPort))
             {
                 throw std::runtime_error{"HTTP server failed to start"};
@@ -118,6 +329,7 @@ protected:
 
     void TearDown() override
     {
+        mRelease.set_value();
         mServer.stop();
         mFuture.get();
     }
@@ -177,6 +389,360 @@ TEST_F(HttpSourceTestF, ReadPartial)
 
 
 
+TEST_F(HttpSourceTestF, InitialRangeIsLent)
+{
+    auto src = HttpSource{gUrlRanges, 1, HttpSource::cDefaultMemoryLimit, nullptr, 4};
+    ASSERT_EQ(gContent.size(), src.GetContentLength());
+
+    auto view = src.View(0, 4);
+    ASSERT_TRUE(view);
+    ASSERT_TRUE(std::ranges::equal(gContentSpan.first(4), view->data));
+    ASSERT_EQ(std::nullopt, src.View(2, 4));
+
+    auto buf = std::string(gContent.size(), '\0');
+    src.Read(0, std::as_writable_bytes(std::span{buf}));
+    ASSERT_EQ(gContent, buf);
+}
+
+TEST_F(HttpSourceTestF, TruncatedResponseIsResumed)
+{
+    auto buf = std::string(gContent.size(), '\0');
+    HttpSource{gUrlTruncated, 1, HttpSource::cDefaultMemoryLimit, nullptr, 0}
+        .Read(0, std::as_writable_bytes(std::span{buf}));
+    ASSERT_EQ(gContent, buf);
+}
+
+TEST_F(HttpSourceTestF, ConcurrentReads)
+{
+    auto src = HttpSource{gUrlRanges, 2};
+
+    auto read =
+        [&src](std::size_t pos)
+        {
+            auto buf = std::string(gContent.size() - pos, '\0');
+            src.Read(pos, std::as_writable_bytes(std::span<char>{buf}));
+            return buf;
+        };
+
+    std::vector<std::future<std::string>> futures;
+    for(std::size_t i = 0; i < 8; ++i)
+    {
+        futures.push_back(std::async(std::launch::async, read, i));
+    }
+
+    for(std::size_t i = 0; i < futures.size(); ++i)
+    {
+        ASSERT_EQ(gContent.substr(i), futures[i].get());
+    }
+}
+
+
+
+TEST_F(HttpSourceTestF, StalledRangeIsHedged)
+{
+    auto src = HttpSource{gUrlStalled, 2, HttpSource::cDefaultMemoryLimit, nullptr, 0};
+    auto buf = std::string(gContent.size(), '\0');
+    //Hedge delay is known only after enough requests
+    for(std::size_t i = 0; i < LatencyTracker::cMinSamples; ++i)
+    {
+        src.Read(0, std::as_writable_bytes(std::span{buf}));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    buf.resize(gContent.size() - cStalledPos);
+    src.Read(cStalledPos, std::as_writable_bytes(std::span{buf}));
+    ASSERT_EQ(gContent.substr(cStalledPos), buf);
+    //Stalled request is released only on teardown
+    ASSERT_LT(std::chrono::steady_clock::now() - start, 5s);
+    ASSERT_EQ(2, mNumStalledRequests);
+}
+
+
+
+//Server doesn't support ranges, so content is downloaded in background and
+//tiny memory limit makes most of it to be kept in temporary file
+TEST_F(HttpSourceTestF, ProgressiveDownloadSpillsIntoFile)
+{
+    auto src = HttpSource{gUrl, 1, 4};
+    for(std::size_t i = 0; i < gContent.size(); i += 3)
+    {
+        auto str = std::string(std::min<std::size_t>(5, gContent.size() - i), '\0');
+        src.Read(i, std::as_writable_bytes(std::span{str}));
+        ASSERT_EQ(gContent.substr(i, str.size()), str);
+    }
+}
+
+
+TEST(LatencyTrackerTests, PercentileNeedsEnoughSamples)
+{
+    auto tracker = LatencyTracker{LatencyTracker::cMinSamples};
+    for(std::size_t i = 1; i < LatencyTracker::cMinSamples; ++i)
+    {
+        tracker.Add(1ms);
+    }
+    ASSERT_EQ(std::nullopt, tracker.Percentile(0.5));
+
+    tracker.Add(1ms);
+    ASSERT_EQ(LatencyTracker::Duration{1ms}, tracker.Percentile(0.5));
+    ASSERT_THROW(tracker.Percentile(1.5), ArgumentError);
+}
+
+TEST(LatencyTrackerTests, OldestSamplesAreReplaced)
+{
+    auto tracker = LatencyTracker{LatencyTracker::cMinSamples};
+    for(std::size_t i = 0; i < LatencyTracker::cMinSamples; ++i)
+    {
+        tracker.Add(100ms);
+    }
+    for(std::size_t i = 0; i < LatencyTracker::cMinSamples - 1; ++i)
+    {
+        tracker.Add(1ms);
+    }
+
+    ASSERT_EQ(LatencyTracker::Duration{1ms}, tracker.Percentile(0.9));
+    ASSERT_EQ(LatencyTracker::Duration{100ms}, tracker.Percentile(1.0));
+}
+
+TEST(ClientPoolTests, ZeroClientsThrows)
+{
+    ASSERT_THROW(ClientPool(gAddress, 0), ArgumentError);
+}
+
+TEST(ClientPoolTests, WaitsForRelease)
+{
+    auto pool = ClientPool{gAddress, 2};
+    auto first = std::optional<ClientPool::Lease>{pool.Acquire()};
+    auto second = pool.Acquire();
+    auto firstPtr = &**first;
+
+    auto third = std::async(
+        std::launch::async,
+        [&pool]()
+        {
+            return &*pool.Acquire();
+        });
+
+    ASSERT_EQ(std::future_status::timeout, third.wait_for(100ms));
+    first.reset();
+    //Released client must be reused instead of creating new one
+    ASSERT_EQ(firstPtr, third.get());
+}
+
+TEST(ClientPoolTests, AcquireIsStoppable)
+{
+    auto pool = ClientPool{gAddress, 1};
+    auto lease = pool.Acquire();
+    ASSERT_TRUE(pool.IsExhausted());
+
+    auto stop = std::stop_source{};
+    auto waiting = std::async(std::launch::async, [&pool, &stop]() { pool.Acquire(stop.get_token()); });
+    stop.request_stop();
+    ASSERT_THROW(waiting.get(), HttplibError);
+}
+
+
+
+TEST(HedgerTests, StalledTransferIsHedged)
+{
+    auto hedger = Hedger{std::make_shared<ClientPool>(gAddress, 2), 1};
+    auto hedged = std::promise<void>{};
+    auto transfer = Hedger::Transfer{};
+    transfer.hedge = [&hedged](std::stop_token) { hedged.set_value(); };
+    transfer.delay = 1ms;
+    transfer.lastProgress = Hedger::Clock::now().time_since_epoch().count();
+
+    hedger.Watch(transfer);
+    ASSERT_EQ(std::future_status::ready, hedged.get_future().wait_for(5s));
+    hedger.Unwatch(transfer);
+}
+
+TEST(HedgerTests, ExhaustedPoolPostponesHedge)
+{
+    auto pool = std::make_shared<ClientPool>(gAddress, 1);
+    auto hedger = Hedger{pool, 1};
+    auto hedged = std::promise<void>{};
+    auto future = hedged.get_future();
+    auto transfer = Hedger::Transfer{};
+    transfer.hedge = [&hedged](std::stop_token) { hedged.set_value(); };
+    transfer.delay = 1ms;
+
+    auto lease = std::optional<ClientPool::Lease>{pool->Acquire()};
+    hedger.Watch(transfer);
+    ASSERT_EQ(std::future_status::timeout, future.wait_for(50ms));
+
+    lease.reset();
+    ASSERT_EQ(std::future_status::ready, future.wait_for(5s));
+    hedger.Unwatch(transfer);
+}
+
+TEST(HedgerTests, UnwatchWaitsForRunningHedge)
+{
+    auto hedger = Hedger{std::make_shared<ClientPool>(gAddress, 2), 1};
+    auto started = std::promise<void>{};
+    auto isStopped = false;
+    auto transfer = Hedger::Transfer{};
+    transfer.hedge =
+        [&started, &isStopped](std::stop_token stop)
+        {
+            auto mtx = std::mutex{};
+            auto cv = std::condition_variable_any{};
+            auto lock = std::unique_lock{mtx};
+            started.set_value();
+            isStopped = !cv.wait(lock, stop, []() { return false; });
+        };
+    transfer.delay = 1ms;
+
+    hedger.Watch(transfer);
+    started.get_future().wait();
+    transfer.stop.request_stop();
+    hedger.Unwatch(transfer);
+    ASSERT_TRUE(isStopped);
+}
+
+
+
+TEST(MemoryBudgetTests, ReservationsAreReturned)
+{
+    auto budget = std::make_shared<MemoryBudget>(10);
+    auto first = budget->TryReserve(6);
+    ASSERT_TRUE(first);
+    ASSERT_FALSE(budget->TryReserve(5));
+
+    auto second = budget->ReserveUpTo(5);
+    ASSERT_EQ(4, second.Size());
+    ASSERT_EQ(10, budget->Used());
+
+    auto third = budget->Reserve(5);
+    ASSERT_EQ(15, budget->Used());
+    ASSERT_EQ(0, budget->ReserveUpTo(1).Size());
+
+    first.reset();
+    second = MemoryBudget::Reservation{};
+    ASSERT_EQ(5, budget->Used());
+}
+
+TEST(ChunkArenaTests, ReleasedBlocksAreReused)
+{
+    auto arena = std::make_shared<ChunkArena>(16, 1);
+    auto block = arena->Allocate();
+    auto other = arena->Allocate();
+    ASSERT_EQ(16, block.Data().size());
+    auto *data = block.Data().data();
+
+    block = ChunkArena::Block{};
+    ASSERT_EQ(1, arena->NumFree());
+    //Only maxFree blocks are kept
+    other = ChunkArena::Block{};
+    ASSERT_EQ(1, arena->NumFree());
+
+    block = arena->Allocate();
+    ASSERT_EQ(data, block.Data().data());
+    ASSERT_EQ(0, arena->NumFree());
+}
+
+TEST(ChunkArenaTests, FreeBlocksFitIntoBudget)
+{
+    auto budget = std::make_shared<MemoryBudget>(40);
+    auto arena = std::make_shared<ChunkArena>(16, 4, false, budget);
+    auto blocks = std::array{arena->Allocate(), arena->Allocate(), arena->Allocate()};
+
+    //Room for single block is left
+    auto reservation = budget->Reserve(20);
+    blocks = {};
+    ASSERT_EQ(1, arena->NumFree());
+
+    reservation = budget->Reserve(30);
+    arena->Trim();
+    ASSERT_EQ(0, arena->NumFree());
+}
+
+TEST(ChunkArenaTests, HugePageBlocksAreUsable)
+{
+    auto arena = std::make_shared<ChunkArena>((1 << 21) + 1, 1, true);
+    auto block = arena->Allocate();
+    auto data = block.Data();
+    ASSERT_EQ((1 << 21) + 1, data.size());
+
+    std::ranges::fill(data, 1_b);
+    ASSERT_EQ(1_b, data.back());
+}
+
+TEST(ProgressiveBufferTests, MemoryPartFitsIntoBudget)
+{
+    auto budget = std::make_shared<MemoryBudget>(4);
+    auto buffer = ProgressiveBuffer{gContentSpan.size(), gContentSpan.size(), budget};
+    ASSERT_EQ(4, budget->Used());
+
+    buffer.Append(gContentSpan);
+    auto str = std::string(gContent.size(), '\0');
+    buffer.Read(0, std::as_writable_bytes(std::span{str}));
+    ASSERT_EQ(gContent, str);
+}
+
+TEST(ProgressiveBufferTests, SpillsIntoFile)
+{
+    auto buffer = ProgressiveBuffer{gContentSpan.size(), 5};
+    for(std::size_t i = 0; i < gContentSpan.size(); i += 4)
+    {
+        buffer.Append(gContentSpan.subspan(i, std::min<std::size_t>(4, gContentSpan.size() - i)));
+    }
+    ASSERT_EQ(gContentSpan.size(), buffer.NumAvailable());
+
+    auto str = std::string(gContent.size() - 2, '\0');
+    buffer.Read(1, std::as_writable_bytes(std::span{str}));
+    ASSERT_EQ(gContent.substr(1, str.size()), str);
+    ASSERT_THROW(buffer.Append(gContentSpan.first(1)), RangeError);
+}
+
+TEST(ProgressiveBufferTests, ReadWaitsForRange)
+{
+    auto buffer = ProgressiveBuffer{gContentSpan.size(), 5};
+    buffer.Append(gContentSpan.first(10));
+
+    auto head = std::string(10, '\0');
+    buffer.Read(0, std::as_writable_bytes(std::span{head}));
+    ASSERT_EQ(gContent.substr(0, 10), head);
+
+    auto tail = std::async(
+        std::launch::async,
+        [&buffer]()
+        {
+            auto str = std::string(gContent.size() - 10, '\0');
+            buffer.Read(10, std::as_writable_bytes(std::span{str}));
+            return str;
+        });
+
+    ASSERT_EQ(std::future_status::timeout, tail.wait_for(100ms));
+    buffer.Append(gContentSpan.subspan(10));
+    ASSERT_EQ(gContent.substr(10), tail.get());
+}
+
+TEST(ProgressiveBufferTests, FailureIsDeliveredToWaiters)
+{
+    auto buffer = ProgressiveBuffer{gContentSpan.size(), gContentSpan.size()};
+    buffer.Append(gContentSpan.first(10));
+
+    auto tail = std::async(
+        std::launch::async,
+        [&buffer]()
+        {
+            auto str = std::string(gContent.size() - 10, '\0');
+            buffer.Read(10, std::as_writable_bytes(std::span{str}));
+        });
+
+    ASSERT_EQ(std::future_status::timeout, tail.wait_for(100ms));
+    buffer.Fail(std::make_exception_ptr(Error{"download failed"}));
+    ASSERT_THROW(tail.get(), Error);
+    ASSERT_TRUE(buffer.Failed());
+
+    //Data arrived before failure are still readable
+    auto head = std::string(10, '\0');
+    ASSERT_NO_THROW(buffer.Read(0, std::as_writable_bytes(std::span{head})));
+    ASSERT_EQ(gContent.substr(0, 10), head);
+}
+
+
+
 TEST(FileSourceTests, ConstructorThrowsIfFileDoesntExist)
 {
     ASSERT_ANY_THROW(FileSource("absurd path to non-existent file"));
@@ -184,6 +750,180 @@ TEST(FileSourceTests, ConstructorThrowsIfFileDoesntExist)
 
 
 
+class DiskCacheTestF : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override
+    {
+        auto nameBuf = std::tmpnam(nullptr);
+        ASSERT_NE(nullptr, nameBuf);
+        dir = std::filesystem::temp_directory_path() / nameBuf;
+    }
+
+    void TearDown() override
+    {
+        auto ec = std::error_code{};
+        std::filesystem::remove_all(dir, ec);
+    }
+};
+
+//Memory source counting reads which reach it
+struct KeyedSource
+{
+    static constexpr bool cConcurrentReads = true;
+
+    std::string key;
+    std::shared_ptr<std::atomic<std::size_t>> numRead =
+        std::make_shared<std::atomic<std::size_t>>(0);
+
+    std::size_t GetContentLength() const noexcept
+    {
+        return gDefaultSource.GetContentLength();
+    }
+
+    std::string GetCacheKey() const
+    {
+        return key;
+    }
+
+    void Read(std::size_t pos, std::span<std::byte> buf)
+    {
+        *numRead += buf.size_bytes();
+        gDefaultSource.Read(pos, buf);
+    }
+};
+
+std::string ReadString(auto &src, std::size_t pos, std::size_t len)
+{
+    auto str = std::string(len, '\0');
+    src.Read(pos, std::as_writable_bytes(std::span{str}));
+    return str;
+}
+
+TEST(DiskCacheTests, KeyHashIsStable)
+{
+    ASSERT_EQ("cbf29ce484222325", DiskCache::HashKey(""));
+    ASSERT_EQ("af63df4c8601f1a5", DiskCache::HashKey("b"));
+}
+
+TEST_F(DiskCacheTestF, SecondRunHitsDisk)
+{
+    auto first = KeyedSource{.key = "url"};
+    auto firstRead = first.numRead;
+    {
+        auto src = DiskCachedSource{std::move(first), dir, 1024, 4};
+        ASSERT_EQ(gContent.substr(3, 9), ReadString(src, 3, 9));
+        //Part of block is read alone and only whole blocks are stored
+        ASSERT_EQ(9, *firstRead);
+        ASSERT_EQ(gContent, ReadString(src, 0, gContent.size()));
+        ASSERT_EQ(9 + gContent.size() - 8, *firstRead);
+    }
+
+    auto second = KeyedSource{.key = "url"};
+    auto secondRead = second.numRead;
+    auto src = DiskCachedSource{std::move(second), dir, 1024, 4};
+    ASSERT_EQ(gContent, ReadString(src, 0, gContent.size()));
+    ASSERT_EQ(gContent.substr(5, 7), ReadString(src, 5, 7));
+    ASSERT_EQ(0, *secondRead);
+
+    //Changed key (e.g. validator) means changed content
+    auto other = KeyedSource{.key = "url\nETag: \"2\""};
+    auto otherRead = other.numRead;
+    auto otherSrc = DiskCachedSource{std::move(other), dir, 1024, 4};
+    ASSERT_EQ(gContent, ReadString(otherSrc, 0, gContent.size()));
+    ASSERT_EQ(gContent.size(), *otherRead);
+}
+
+TEST_F(DiskCacheTestF, EvictsLeastRecentlyUsed)
+{
+    {
+        auto src = DiskCachedSource{KeyedSource{.key = "url"}, dir, 8, 4};
+        ReadString(src, 0, 4);
+        ReadString(src, 4, 4);
+        ReadString(src, 0, 4);
+        ReadString(src, 8, 4);
+    }
+
+    //Size limit is applied on opening too
+    auto cache = DiskCache{dir, "other", 4};
+    ASSERT_GE(4, cache.TotalSize());
+
+    auto source = KeyedSource{.key = "url"};
+    auto numRead = source.numRead;
+    auto src = DiskCachedSource{std::move(source), dir, 1024, 4};
+    ReadString(src, 8, 4);
+    ASSERT_EQ(0, *numRead);
+    ReadString(src, 0, 4);
+    ReadString(src, 4, 4);
+    ASSERT_EQ(8, *numRead);
+}
+
+TEST_F(DiskCacheTestF, SidecarBelongsToContent)
+{
+    auto path = std::filesystem::path{};
+    {
+        auto src = DiskCachedSource{KeyedSource{.key = "url"}, dir, 4, 4};
+        path = src.GetSidecarPath("sidecar");
+        std::ofstream{path} << "data";
+        //Eviction of blocks leaves it untouched
+        ReadString(src, 0, 4);
+        ReadString(src, 4, 4);
+    }
+
+    {
+        auto src = DiskCachedSource{KeyedSource{.key = "url"}, dir, 4, 4};
+        ASSERT_EQ(path, src.GetSidecarPath("sidecar"));
+        ASSERT_TRUE(std::filesystem::exists(path));
+    }
+
+    //Changed content doesn't see sidecar of previous one
+    auto src = DiskCachedSource{KeyedSource{.key = "url\nETag: \"2\""}, dir, 4, 4};
+    auto otherPath = src.GetSidecarPath("sidecar");
+    ASSERT_NE(path, otherPath);
+    ASSERT_FALSE(std::filesystem::exists(otherPath));
+}
+
+TEST_F(DiskCacheTestF, SidecarsCountAndAreRemovedWithLastBlock)
+{
+    auto path = std::filesystem::path{};
+    {
+        auto src = DiskCachedSource{KeyedSource{.key = "url"}, dir, 8, 4};
+        path = src.GetSidecarPath("sidecar");
+        std::ofstream{path} << "data";
+        ReadString(src, 0, 4);
+    }
+
+    auto cache = DiskCache{dir, "other", 8};
+    ASSERT_EQ(8, cache.TotalSize());
+
+    //Block of other content is evicted and its directory goes with it
+    auto data = std::array<std::byte, 4>{};
+    cache.Store(0, data);
+    ASSERT_EQ(4, cache.TotalSize());
+    ASSERT_FALSE(std::filesystem::exists(path.parent_path()));
+    ASSERT_TRUE(std::filesystem::exists(cache.Dir()));
+}
+
+TEST_F(DiskCacheTestF, UnusableDirectoryIsPassedThrough)
+{
+    //Directory can't be created where regular file is
+    std::ofstream{dir} << "file";
+
+    auto source = KeyedSource{.key = "url"};
+    auto numRead = source.numRead;
+    auto src = DiskCachedSource{std::move(source), dir, 1024, 4};
+    ASSERT_FALSE(src.IsPersistent());
+    ASSERT_TRUE(src.GetSidecarPath("sidecar").empty());
+
+    ASSERT_EQ(gContent, ReadString(src, 0, gContent.size()));
+    ASSERT_EQ(gContent, ReadString(src, 0, gContent.size()));
+    ASSERT_EQ(2 * gContent.size(), *numRead);
+}
+
+
+
 class MockSource
 {
 public:
@@ -213,6 +953,89 @@ public:
     std::unique_ptr<MockSource> impl = std::make_unique<MockSource>();
 };
 
+class ConcurrentMockSourceWrapper : public MockSourceWrapper
+{
+public:
+    static constexpr bool cConcurrentReads = true;
+};
+
+class LimitedMockSourceWrapper : public ConcurrentMockSourceWrapper
+{
+public:
+    std::size_t GetMaxConcurrentReads() const
+    {
+        return 2;
+    }
+};
+
+class VectoredMockSource
+{
+public:
+    MOCK_METHOD(void, Read, (std::size_t pos, std::span<std::byte> buf));
+    MOCK_METHOD(void, ReadV, (std::span<const ReadRequest> requests));
+    MOCK_METHOD(std::size_t, GetContentLength, (), (const));
+};
+
+class VectoredMockSourceWrapper
+{
+public:
+    std::size_t GetContentLength() const
+    {
+        return impl->GetContentLength();
+    }
+
+    void Read(std::size_t pos, std::span<std::byte> buf)
+    {
+        return impl->Read(pos, buf);
+    }
+
+    void ReadV(std::span<const ReadRequest> requests)
+    {
+        return impl->ReadV(requests);
+    }
+
+    std::unique_ptr<VectoredMockSource> impl = std::make_unique<VectoredMockSource>();
+};
+
+//Calls hook before chunk is inserted, while cache lock is held
+class HookedLruPolicy
+{
+public:
+    void Insert(std::size_t id)
+    {
+        if(onInsert)
+        {
+            onInsert(id);
+        }
+        lru.Insert(id);
+    }
+
+    void Touch(std::size_t id)
+    {
+        lru.Touch(id);
+    }
+
+    void Erase(std::size_t id)
+    {
+        lru.Erase(id);
+    }
+
+    std::optional<std::size_t> Evict()
+    {
+        return lru.Evict();
+    }
+
+    std::size_t Size() const
+    {
+        return lru.Size();
+    }
+
+    static inline std::function<void(std::size_t)> onInsert;
+
+private:
+    LruPolicy lru;
+};
+
 TEST(CachedSourceTests, ZeroChunkSizeThrows)
 {
     ASSERT_THROW(CachedSource(MemoryViewSource{}, 1, 0), ArgumentError);
@@ -238,72 +1061,370 @@ TEST(CachedSourceTests, ReadFullLittleChunksNoCache)
     ASSERT_EQ(1, source.NumCachedChunks());
 }
 
-TEST(CachedSourceTests, ReadFullLittleChunksUnlimitedCache)
+TEST(CachedSourceTests, ReadFullLittleChunksUnlimitedCache)
+{
+    auto buf = std::string(gContent.size(), '\0');
+    auto span = std::span<char>{buf};
+    auto source = CachedSource{gDefaultSource, 0, 1};
+    source.Read(0, std::as_writable_bytes(span));
+    ASSERT_EQ(gContent, buf);
+    ASSERT_EQ(gContent.size(), source.NumCachedChunks());
+}
+
+TEST(CachedSourceTests, ReadPartialNeighborChunksRepeated)
+{
+    if(gContent.size() < 8)
+    {
+        FAIL();
+    }
+
+    auto half = gContent.size() / 2;
+    auto quarter = gContent.size() / 4;
+    auto eighth = gContent.size() / 8;
+
+    auto buf = std::string(half, '\0');
+    auto span = std::span<char>{buf};
+    auto source = CachedSource{gDefaultSource, 0, half};
+
+    source.Read(quarter, std::as_writable_bytes(span));
+    ASSERT_EQ(gContent.substr(quarter, half), buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+
+    source.Read(eighth, std::as_writable_bytes(span));
+    ASSERT_EQ(gContent.substr(eighth, half), buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+}
+
+TEST(CachedSourceTests, DiscardsLeastUsed)
+{
+    using namespace vd::literals;
+
+    auto wrapper = MockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+    
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(30));
+    EXPECT_CALL(*mock, Read(Eq(10),_)).
+        Times(Exactly(2));
+    EXPECT_CALL(*mock, Read(Eq(0),_)).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(20),_)).
+        Times(Exactly(1));
+
+    auto source = CachedSource<MockSourceWrapper>{std::move(wrapper), 2, 10};
+
+    auto arr = MakeArray<1>(1_b);
+    auto buf = std::span<std::byte>(arr);
+    source.Read(0, buf);
+    ASSERT_EQ(1, source.NumCachedChunks());
+    source.Read(10, buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+    source.Read(0, buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+    source.Read(20, buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+    source.Read(0, buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+    source.Read(10, buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+}
+
+TEST(CachedSourceTests, BudgetLimitsCachedBytes)
+{
+    using namespace vd::literals;
+
+    auto wrapper = MockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(30));
+    EXPECT_CALL(*mock, Read(Eq(0),_)).
+        Times(Exactly(2));
+    EXPECT_CALL(*mock, Read(Eq(10),_)).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(20),_)).
+        Times(Exactly(1));
+
+    auto budget = std::make_shared<MemoryBudget>(20);
+    auto source = CachedSource<MockSourceWrapper>{std::move(wrapper), 0, 10, 0, budget};
+
+    auto arr = MakeArray<1>(1_b);
+    auto buf = std::span<std::byte>(arr);
+    source.Read(0, buf);
+    source.Read(10, buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+    ASSERT_EQ(20, budget->Used());
+    source.Read(20, buf);
+    ASSERT_EQ(2, source.NumCachedChunks());
+    ASSERT_EQ(20, budget->Used());
+    source.Read(0, buf);
+
+    //Viewed chunks stay accounted until views are destroyed, so budget is
+    //exceeded when there is nothing to discard
+    auto views = std::array{source.View(0, 1), source.View(20, 1)};
+    EXPECT_CALL(*mock, Read(Eq(10),_)).
+        Times(Exactly(1));
+    source.Read(10, buf);
+    ASSERT_EQ(1, source.NumCachedChunks());
+    ASSERT_EQ(30, budget->Used());
+
+    views = {};
+    ASSERT_EQ(10, budget->Used());
+}
+
+TEST(CachedSourceTests, PinnedChunkIsNotDiscarded)
+{
+    using namespace vd::literals;
+
+    auto wrapper = MockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(30));
+    EXPECT_CALL(*mock, Read(Eq(0),_)).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(10),_)).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(20),_)).
+        Times(Exactly(1));
+
+    auto source = CachedSource<MockSourceWrapper>{std::move(wrapper), 1, 10};
+    source.Pin(5, 1);
+
+    auto arr = MakeArray<1>(1_b);
+    auto buf = std::span<std::byte>(arr);
+    source.Read(0, buf);
+    source.Read(10, buf);
+    source.Read(20, buf);
+    source.Read(0, buf);
+    //Pinned chunk isn't counted
+    ASSERT_EQ(2, source.NumCachedChunks());
+
+    //Chunk is put under policy control again, so limit is applied
+    source.Unpin(0, 10);
+    ASSERT_EQ(1, source.NumCachedChunks());
+    source.Read(0, buf);
+}
+
+TEST(TwoQueuePolicyTests, ScanDoesntFlushReusedChunk)
+{
+    constexpr std::size_t capacity = 4;
+    auto policy = TwoQueuePolicy{};
+    auto insert =
+        [&policy](std::size_t id)
+        {
+            auto evicted = std::optional<std::size_t>{};
+            if(policy.Size() == capacity)
+            {
+                evicted = policy.Evict();
+            }
+            policy.Insert(id);
+            return evicted;
+        };
+
+    //Chunk is reused after it was evicted by other chunks
+    for(std::size_t id = 0; id <= capacity; ++id)
+    {
+        insert(id);
+    }
+    ASSERT_EQ(1, insert(0));
+
+    //Long sequential scan evicts only itself and other chunks used once
+    for(std::size_t id = 100; id < 200; ++id)
+    {
+        ASSERT_NE(0, insert(id));
+        policy.Touch(id);
+    }
+
+    policy.Erase(0);
+    ASSERT_EQ(capacity - 1, policy.Size());
+}
+
+TEST(TwoQueuePolicyTests, HitInMainQueueGivesSecondChance)
+{
+    auto policy = TwoQueuePolicy{};
+    for(std::size_t id = 1; id <= 2; ++id)
+    {
+        policy.Insert(id);
+        ASSERT_EQ(id, policy.Evict());
+    }
+
+    //Both chunks are reused, so they get into main queue
+    policy.Insert(1);
+    policy.Insert(2);
+    policy.Touch(1);
+    ASSERT_EQ(2, policy.Evict());
+    ASSERT_EQ(1, policy.Evict());
+    ASSERT_EQ(std::nullopt, policy.Evict());
+}
+
+TEST(LruPolicyTests, EvictsLeastRecentlyUsed)
+{
+    auto lru = LruPolicy{};
+    lru.Insert(1);
+    lru.Insert(2);
+    lru.Touch(1);
+    ASSERT_EQ(2, lru.Evict());
+}
+
+TEST(ClockPolicyTests, ReferencedChunkGetsSecondChance)
 {
-    auto buf = std::string(gContent.size(), '\0');
-    auto span = std::span<char>{buf};
-    auto source = CachedSource{gDefaultSource, 0, 1};
-    source.Read(0, std::as_writable_bytes(span));
-    ASSERT_EQ(gContent, buf);
-    ASSERT_EQ(gContent.size(), source.NumCachedChunks());
+    auto clock = ClockPolicy{};
+    clock.Insert(1);
+    clock.Insert(2);
+    clock.Insert(3);
+    clock.Touch(1);
+    clock.Erase(3);
+    ASSERT_EQ(2, clock.Size());
+    ASSERT_EQ(2, clock.Evict());
+    ASSERT_EQ(1, clock.Evict());
+    ASSERT_EQ(std::nullopt, clock.Evict());
 }
 
-TEST(CachedSourceTests, ReadPartialNeighborChunksRepeated)
+TEST(ClockPolicyTests, TableGrowsBeyondCapacity)
 {
-    if(gContent.size() < 8)
+    auto clock = ClockPolicy{4};
+    for(std::size_t id = 0; id < 100; ++id)
     {
-        FAIL();
+        clock.Insert(id * 16);
     }
 
-    auto half = gContent.size() / 2;
-    auto quarter = gContent.size() / 4;
-    auto eighth = gContent.size() / 8;
-
-    auto buf = std::string(half, '\0');
-    auto span = std::span<char>{buf};
-    auto source = CachedSource{gDefaultSource, 0, half};
-
-    source.Read(quarter, std::as_writable_bytes(span));
-    ASSERT_EQ(gContent.substr(quarter, half), buf);
-    ASSERT_EQ(2, source.NumCachedChunks());
+    for(std::size_t id = 1; id < 100; ++id)
+    {
+        clock.Touch(id * 16);
+    }
 
-    source.Read(eighth, std::as_writable_bytes(span));
-    ASSERT_EQ(gContent.substr(eighth, half), buf);
-    ASSERT_EQ(2, source.NumCachedChunks());
+    ASSERT_EQ(100, clock.Size());
+    ASSERT_EQ(0, clock.Evict());
 }
 
-TEST(CachedSourceTests, DiscardsLeastUsed)
+TEST(CachedSourceTests, HitsArePassedToPolicy)
 {
-    using namespace vd::literals;
-
     auto wrapper = MockSourceWrapper{};
     auto mock = wrapper.impl.get();
-    
+
     ON_CALL(*mock, GetContentLength)
             .WillByDefault(Return(30));
-    EXPECT_CALL(*mock, Read(Eq(10),_)).
-        Times(Exactly(2));
     EXPECT_CALL(*mock, Read(Eq(0),_)).
         Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(10),_)).
+        Times(Exactly(1));
     EXPECT_CALL(*mock, Read(Eq(20),_)).
         Times(Exactly(1));
 
-    auto source = CachedSource<MockSourceWrapper>{std::move(wrapper), 2, 10};
+    auto source = CachedSource<MockSourceWrapper, ClockPolicy>{std::move(wrapper), 2, 10};
 
     auto arr = MakeArray<1>(1_b);
     auto buf = std::span<std::byte>(arr);
     source.Read(0, buf);
-    ASSERT_EQ(1, source.NumCachedChunks());
     source.Read(10, buf);
-    ASSERT_EQ(2, source.NumCachedChunks());
+    //Chunk 0 is referenced, so chunk 1 is discarded
     source.Read(0, buf);
-    ASSERT_EQ(2, source.NumCachedChunks());
     source.Read(20, buf);
-    ASSERT_EQ(2, source.NumCachedChunks());
     source.Read(0, buf);
     ASSERT_EQ(2, source.NumCachedChunks());
-    source.Read(10, buf);
-    ASSERT_EQ(2, source.NumCachedChunks());
+}
+
+TEST(CachedSourceTests, MissingChunksAreReadTogether)
+{
+    auto wrapper = VectoredMockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    //Positions of read requests grouped by ReadV call
+    auto calls = std::vector<std::vector<std::size_t>>{};
+    auto save =
+        [&calls](std::span<const ReadRequest> requests)
+        {
+            auto &positions = calls.emplace_back();
+            for(const auto &request : requests)
+            {
+                positions.push_back(request.pos);
+            }
+        };
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(30));
+    EXPECT_CALL(*mock, Read(_,_)).
+        Times(Exactly(0));
+    EXPECT_CALL(*mock, ReadV(_)).
+        Times(Exactly(2)).
+        WillRepeatedly(save);
+
+    auto source = CachedSource<VectoredMockSourceWrapper>{std::move(wrapper), 0, 4};
+
+    auto arr = std::array<std::byte, 16>{};
+    auto buf = std::span<std::byte>(arr);
+    source.Read(4, buf.first(4));
+    //Chunk 1 is cached already, so only the rest is requested
+    source.Read(0, buf);
+
+    auto expected = std::vector<std::vector<std::size_t>>{{4}, {0, 8, 12}};
+    ASSERT_EQ(expected, calls);
+    ASSERT_EQ(4, source.NumCachedChunks());
+}
+
+TEST(CachedSourceTests, SmallReadsFillOnlySectors)
+{
+    auto wrapper = MockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(64));
+    //Every next read of chunk fills as much as it's valid already
+    EXPECT_CALL(*mock, Read(Eq(0), SizeIs(4))).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(4), SizeIs(4))).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(8), SizeIs(8))).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(16), SizeIs(16))).
+        Times(Exactly(1));
+
+    auto source = CachedSource<MockSourceWrapper>{std::move(wrapper), 0, 64, 0, nullptr, 4};
+
+    auto arr = MakeArray<2>(1_b);
+    auto buf = std::span<std::byte>(arr);
+    source.Read(1, buf);
+    source.Read(2, buf);
+    source.Read(6, buf);
+    source.Read(9, buf);
+    source.Read(17, buf);
+    source.Read(30, buf);
+
+    auto stats = source.GetStats();
+    ASSERT_EQ(32, stats.fetchedBytes);
+    ASSERT_EQ(12, stats.consumedBytes);
+    ASSERT_EQ(1, source.NumCachedChunks());
+}
+
+TEST(CachedSourceTests, SequentialReadFillsRestOfChunk)
+{
+    auto wrapper = MockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(48));
+    auto readAhead = std::latch{1};
+    EXPECT_CALL(*mock, Read(Eq(14), SizeIs(2))).
+        Times(Exactly(1));
+    //Second chunk in a row is sequential access, so it's filled entirely
+    //and next one is read in background
+    EXPECT_CALL(*mock, Read(Eq(16), SizeIs(16))).
+        Times(Exactly(1));
+    EXPECT_CALL(*mock, Read(Eq(32), SizeIs(16))).
+        WillOnce([&readAhead](auto, auto) { readAhead.count_down(); });
+
+    auto source = CachedSource<MockSourceWrapper>{std::move(wrapper), 0, 16, 1, nullptr, 2};
+
+    auto arr = MakeArray<2>(1_b);
+    auto buf = std::span<std::byte>(arr);
+    source.Read(14, buf);
+    source.Read(16, buf.first(1));
+
+    //Chunk is pending once it's read, so demand read just waits for it
+    readAhead.wait();
+    source.Read(32, buf.first(1));
+    ASSERT_EQ(3, source.NumCachedChunks());
 }
 
 //Test case based on issue accidentally found by other generic test
@@ -318,6 +1439,128 @@ TEST(CachedSourceTests, ReadingPastEndOfAlreadyCachedChunk)
     ASSERT_THROW(src.Read(gContent.size(), buf), RangeError);
 }
 
+TEST(CachedSourceTests, ViewKeepsChunkAlive)
+{
+    auto wrapper = MockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+    
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(20));
+    EXPECT_CALL(*mock, Read(Eq(0),_))
+        .WillOnce([](auto, auto buf) { buf[5] = 5_b; });
+    EXPECT_CALL(*mock, Read(Eq(10),_))
+        .Times(Exactly(1));
+
+    auto source = CachedSource<MockSourceWrapper>{std::move(wrapper), 1, 10};
+
+    auto view = source.View(5, 5);
+    ASSERT_TRUE(view);
+    ASSERT_EQ(5, view->data.size());
+    ASSERT_EQ(5_b, view->data[0]);
+
+    //Chunk crossing
+    ASSERT_FALSE(source.View(5, 6));
+
+    //First chunk is discarded from cache, but not from memory
+    auto arr = MakeArray<1>(1_b);
+    source.Read(10, std::span<std::byte>(arr));
+    ASSERT_EQ(1, source.NumCachedChunks());
+    ASSERT_EQ(5_b, view->data[0]);
+}
+
+TEST(CachedSourceTests, ViewableSourceIsNotCopied)
+{
+    auto source = CachedSource{gDefaultSource, 0, 4};
+    auto view = source.View(1, 2);
+    ASSERT_TRUE(view);
+    ASSERT_EQ(std::next(gContentSpan.data(), 1), view->data.data());
+
+    //Even crossing chunks is allowed because source lends memory itself
+    view = source.View(1, 8);
+    ASSERT_TRUE(view);
+    ASSERT_EQ(std::next(gContentSpan.data(), 1), view->data.data());
+}
+
+TEST(CachedSourceTests, ReadAheadOnSequentialAccess)
+{
+    auto wrapper = ConcurrentMockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(4));
+    auto readAhead = std::latch{2};
+    for(std::size_t i = 0; i < 4; ++i)
+    {
+        EXPECT_CALL(*mock, Read(Eq(i),_))
+            .WillOnce(
+                [i, &readAhead](auto, auto)
+                {
+                    if(i >= 2)
+                    {
+                        readAhead.count_down();
+                    }
+                });
+    }
+
+    auto source = CachedSource<ConcurrentMockSourceWrapper>{std::move(wrapper), 0, 1, 2};
+    //Read-ahead must survive moving
+    auto moved = CachedSource{std::move(source)};
+
+    auto byte = std::byte{};
+    moved.Read(0, std::span(&byte, 1));
+    moved.Read(1, std::span(&byte, 1));
+
+    //Chunks are pending once they're read, so reads just wait for them
+    readAhead.wait();
+    moved.Read(2, std::span(&byte, 1));
+    moved.Read(3, std::span(&byte, 1));
+    ASSERT_EQ(4, moved.NumCachedChunks());
+}
+
+TEST(CachedSourceTests, ReadAheadFitsIntoCache)
+{
+    auto budget = std::make_shared<MemoryBudget>(40);
+    ASSERT_EQ(2, CalcMaxReadAhead(4, 10, budget.get()));
+    //Budget limits cache of unlimited number of chunks
+    ASSERT_EQ(2, CalcMaxReadAhead(0, 10, budget.get()));
+    ASSERT_EQ(0, CalcMaxReadAhead(0, 50, budget.get()));
+    ASSERT_EQ(std::numeric_limits<std::size_t>::max(), CalcMaxReadAhead(0, 10, nullptr));
+}
+
+TEST(CachedSourceTests, NoReadAheadOnRandomAccess)
+{
+    auto wrapper = ConcurrentMockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(10));
+    for(std::size_t pos : {0, 5, 2, 7, 8})
+    {
+        EXPECT_CALL(*mock, Read(Eq(pos),_))
+            .Times(Exactly(1));
+    }
+    //Read-ahead is done in order, so chunks scheduled by random accesses
+    //would be read before this one
+    auto readAhead = std::latch{1};
+    EXPECT_CALL(*mock, Read(Eq(9),_))
+        .WillOnce([&readAhead](auto, auto) { readAhead.count_down(); });
+
+    auto source = CachedSource<ConcurrentMockSourceWrapper>{std::move(wrapper), 0, 1, 2};
+
+    auto byte = std::byte{};
+    source.Read(0, std::span(&byte, 1));
+    source.Read(5, std::span(&byte, 1));
+    source.Read(2, std::span(&byte, 1));
+    source.Read(0, std::span(&byte, 1));
+    ASSERT_EQ(3, source.NumCachedChunks());
+
+    source.Read(7, std::span(&byte, 1));
+    source.Read(8, std::span(&byte, 1));
+    readAhead.wait();
+    source.Read(9, std::span(&byte, 1));
+    ASSERT_EQ(6, source.NumCachedChunks());
+}
+
 TEST(CachedSourceThreadSafetyTests, SimultaneousCachingSingleChunk)
 {
     //Basic scenario is that we start two threads, ensure priority for first
@@ -447,6 +1690,235 @@ TEST(CachedSourceThreadSafetyTests, CachedReadsDontWait)
 
 
 
+TEST(CachedSourceThreadSafetyTests, DifferentChunksAreFetchedInParallel)
+{
+    auto wrapper = ConcurrentMockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+    auto src = CachedSource{std::move(wrapper), 0, 1};
+
+    auto mtx = std::mutex{};
+    auto cv = std::condition_variable{};
+    std::size_t numReading = 0;
+
+    //Every read waits until other one is started, which is impossible if
+    //reads are serialized (timeout is here to avoid deadlock then)
+    auto read =
+        [&mtx, &cv, &numReading](auto, auto buf)
+        {
+            std::unique_lock lock(mtx);
+            numReading += 1;
+            cv.notify_all();
+            if(cv.wait_for(lock, 5s, [&numReading]{ return numReading == 2; }))
+            {
+                buf[0] = 1_b;
+            }
+        };
+
+    EXPECT_CALL(*mock, Read)
+        .Times(Exactly(2))
+        .WillRepeatedly(read);
+    EXPECT_CALL(*mock, GetContentLength)
+        .WillRepeatedly([]() { return gContent.size(); });
+
+    auto t1Byte = std::byte{};
+    auto t2Byte = std::byte{};
+    std::thread t1([&src, &t1Byte]() { src.Read(0, std::span(&t1Byte, 1)); });
+    std::thread t2([&src, &t2Byte]() { src.Read(1, std::span(&t2Byte, 1)); });
+    t1.join();
+    t2.join();
+
+    ASSERT_EQ(1_b, t1Byte);
+    ASSERT_EQ(1_b, t2Byte);
+    ASSERT_EQ(2, src.NumCachedChunks());
+}
+
+TEST(CachedSourceThreadSafetyTests, FailedFetchIsDeliveredToWaitersAndRetried)
+{
+    auto wrapper = ConcurrentMockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+    auto src = CachedSource{std::move(wrapper), 0, 1};
+
+    EXPECT_CALL(*mock, GetContentLength)
+        .WillRepeatedly([]() { return gContent.size(); });
+    EXPECT_CALL(*mock, Read)
+        .WillOnce(
+            [](auto, auto)
+            {
+                std::this_thread::sleep_for(250ms);
+                throw Error{"fetch failed"};
+            })
+        .WillOnce([](auto, auto buf) { buf[0] = 1_b; });
+
+    auto read =
+        [&src]()
+        {
+            auto byte = std::byte{};
+            src.Read(0, std::span(&byte, 1));
+        };
+
+    auto f1 = std::async(std::launch::async, read);
+    std::this_thread::sleep_for(50ms);
+    auto f2 = std::async(std::launch::async, read);
+
+    ASSERT_THROW(f1.get(), Error);
+    ASSERT_THROW(f2.get(), Error);
+    ASSERT_EQ(0, src.NumCachedChunks());
+
+    auto byte = std::byte{};
+    src.Read(0, std::span(&byte, 1));
+    ASSERT_EQ(1_b, byte);
+    ASSERT_EQ(1, src.NumCachedChunks());
+}
+
+TEST(CachedSourceThreadSafetyTests, RefilledChunkDoesNotExposeStaleSectors)
+{
+    auto wrapper = ConcurrentMockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    EXPECT_CALL(*mock, GetContentLength)
+        .WillRepeatedly(Return(8));
+    EXPECT_CALL(*mock, Read)
+        .Times(AnyNumber())
+        .WillRepeatedly(
+            [](auto pos, auto buf)
+            {
+                std::ranges::copy(gContentSpan.subspan(pos, buf.size()), buf.begin());
+            });
+
+    auto src = CachedSource<ConcurrentMockSourceWrapper, HookedLruPolicy>{
+        std::move(wrapper), 1, 4, 0, nullptr, 1};
+
+    //Sector 0 of chunk 0 is valid, then chunk is evicted while view keeps
+    //its buffer alive, so refill has to allocate new one
+    auto byte = std::byte{};
+    src.Read(0, std::span(&byte, 1));
+    auto view = src.View(0, 1);
+    src.Read(4, std::span(&byte, 1));
+
+    //Hit of old sector is attempted while refilled chunk is inserted, it
+    //mustn't finish before sector is read again
+    auto hit = std::future<std::byte>{};
+    auto isHitDuringInsert = false;
+    HookedLruPolicy::onInsert =
+        [&src, &hit, &isHitDuringInsert](std::size_t id)
+        {
+            if(id != 0 || hit.valid())
+            {
+                return;
+            }
+            hit = std::async(
+                std::launch::async,
+                [&src]()
+                {
+                    auto hitByte = std::byte{};
+                    src.Read(0, std::span(&hitByte, 1));
+                    return hitByte;
+                });
+            isHitDuringInsert = hit.wait_for(250ms) == std::future_status::ready;
+        };
+
+    src.Read(2, std::span(&byte, 1));
+    auto hitByte = hit.valid() ? hit.get() : std::byte{};
+    HookedLruPolicy::onInsert = nullptr;
+
+    ASSERT_EQ(gContentSpan[2], byte);
+    ASSERT_FALSE(isHitDuringInsert);
+    ASSERT_EQ(gContentSpan[0], hitByte);
+}
+
+TEST(CachedSourceTests, PrefetchedChunkIsNotReadAgain)
+{
+    auto wrapper = MockSourceWrapper{};
+    auto mock = wrapper.impl.get();
+
+    ON_CALL(*mock, GetContentLength)
+            .WillByDefault(Return(30));
+    EXPECT_CALL(*mock, Read(Eq(20),_)).
+        Times(Exactly(1));
+
+    auto src = CachedSource{std::move(wrapper), 2, 10};
+    src.Prefetch(25, 5);
+    ASSERT_EQ(1, src.NumCachedChunks());
+    ASSERT_EQ(0, src.GetStats().consumedBytes);
+
+    auto buf = std::array<std::byte, 10>{};
+    src.Read(20, buf);
+    ASSERT_EQ(10, src.GetStats().consumedBytes);
+}
+
+TEST(FetchSchedulerTests, DemandBypassesWaitingSpeculative)
+{
+    auto scheduler = FetchScheduler{1};
+    auto order = std::vector<FetchPriority>{};
+    auto mtx = std::mutex{};
+
+    auto fetch =
+        [&](FetchPriority priority)
+        {
+            auto permit = scheduler.Acquire(priority);
+            std::lock_guard lock{mtx};
+            order.push_back(priority);
+        };
+    auto waitForWaiter =
+        [&scheduler](FetchPriority priority)
+        {
+            while(scheduler.NumWaiting(priority) == 0)
+            {
+                std::this_thread::yield();
+            }
+        };
+
+    auto f = std::future<void>{};
+    auto g = std::future<void>{};
+    {
+        auto permit = scheduler.Acquire(FetchPriority::Demand);
+        f = std::async(std::launch::async, fetch, FetchPriority::Speculative);
+        waitForWaiter(FetchPriority::Speculative);
+        g = std::async(std::launch::async, fetch, FetchPriority::Demand);
+        waitForWaiter(FetchPriority::Demand);
+    }
+
+    f.get();
+    g.get();
+    ASSERT_THAT(order, ElementsAre(FetchPriority::Demand, FetchPriority::Speculative));
+}
+
+TEST(FetchSchedulerTests, SpeculativeLeavesSlotForDemand)
+{
+    auto scheduler = FetchScheduler{2};
+    auto demand = scheduler.TryAcquire(FetchPriority::Demand);
+    ASSERT_TRUE(demand);
+    ASSERT_FALSE(scheduler.TryAcquire(FetchPriority::Speculative));
+
+    //Idle slot is left while speculative fetch runs
+    demand.reset();
+    auto speculative = scheduler.TryAcquire(FetchPriority::Speculative);
+    ASSERT_TRUE(speculative);
+    ASSERT_TRUE(scheduler.TryAcquire(FetchPriority::Demand));
+}
+
+TEST(FetchSchedulerTests, SpeculativeUsesIdleCapacity)
+{
+    auto scheduler = FetchScheduler{3};
+    auto demand = scheduler.TryAcquire(FetchPriority::Demand);
+    auto metadata = scheduler.TryAcquire(FetchPriority::Metadata);
+    ASSERT_FALSE(scheduler.TryAcquire(FetchPriority::Speculative));
+    metadata.reset();
+    ASSERT_TRUE(scheduler.TryAcquire(FetchPriority::Speculative));
+
+    //Capacity of unlimited scheduler is never exhausted
+    auto unlimited = FetchScheduler{0};
+    demand = unlimited.TryAcquire(FetchPriority::Demand);
+    ASSERT_TRUE(unlimited.TryAcquire(FetchPriority::Speculative));
+}
+
+TEST(FetchSchedulerTests, LimitIsTakenFromSource)
+{
+    ASSERT_EQ(1, GetMaxConcurrentReads(MockSourceWrapper{}));
+    ASSERT_EQ(0, GetMaxConcurrentReads(ConcurrentMockSourceWrapper{}));
+    ASSERT_EQ(2, GetMaxConcurrentReads(LimitedMockSourceWrapper{}));
+}
+
 TEST(ThreadSafeSourceTests, RaceIfUnguarded)
 {
     MockSource mock;
@@ -590,12 +2062,13 @@ struct MemoryViewSourceWrapper
     }
 };
 
-struct FileSourceWrapper
+template <typename FileSourceT>
+struct FileSourceWrapperBase
 {
-    std::unique_ptr<FileSource> impl;
+    std::unique_ptr<FileSourceT> impl;
     std::filesystem::path tmpFilePath;
 
-    FileSourceWrapper()
+    FileSourceWrapperBase()
     {
         //There is some hint about tread safety on cppreference, but
         //tests are running in a single threaded manner, so doesn't matter
@@ -620,10 +2093,10 @@ struct FileSourceWrapper
         }
 
         of.close();
-        impl.reset(new FileSource(tmpFilePath));
+        impl.reset(new FileSourceT(tmpFilePath));
     }
 
-    ~FileSourceWrapper()
+    ~FileSourceWrapperBase()
     {
         try
         {
@@ -642,6 +2115,63 @@ struct FileSourceWrapper
     }
 };
 
+using FileSourceWrapper = FileSourceWrapperBase<FileSource>;
+using MappedFileSourceWrapper = FileSourceWrapperBase<MappedFileSource>;
+
+TEST(FileSourceTests, ConcurrentReads)
+{
+    auto wrapper = FileSourceWrapper{};
+    auto &src = *wrapper.impl;
+
+    //Every thread reads whole content byte by byte starting from different
+    //offset, so reads of different threads always interleave
+    auto read =
+        [&src](std::size_t shift)
+        {
+            auto buf = std::string(gContent.size(), '\0');
+            for(std::size_t i = 0; i < gContent.size(); ++i)
+            {
+                auto pos = (i + shift) % gContent.size();
+                src.Read(pos, std::as_writable_bytes(std::span<char>{&buf[pos], 1}));
+            }
+
+            return buf;
+        };
+
+    std::vector<std::future<std::string>> futures;
+    for(std::size_t i = 0; i < 8; ++i)
+    {
+        futures.push_back(std::async(std::launch::async, read, i));
+    }
+
+    for(auto &f : futures)
+    {
+        ASSERT_EQ(gContent, f.get());
+    }
+}
+
+TEST(MappedFileSourceTests, ViewOutlivesSource)
+{
+    auto wrapper = MappedFileSourceWrapper{};
+    auto view = wrapper.impl->View(1, gContent.size() - 1);
+    ASSERT_TRUE(view);
+
+    wrapper.impl.reset();
+
+    auto str = std::string(reinterpret_cast<const char *>(view->data.data()), view->data.size());
+    ASSERT_EQ(gContent.substr(1), str);
+    ASSERT_THROW(MappedFileSourceWrapper{}.impl->View(1, gContent.size()), RangeError);
+}
+
+TEST(MemoryViewSourceTests, ViewIsNotCopy)
+{
+    auto src = MemoryViewSource{gContentSpan};
+    auto view = src.View(2, 3);
+    ASSERT_TRUE(view);
+    ASSERT_EQ(std::next(gContentSpan.data(), 2), view->data.data());
+    ASSERT_EQ(3, view->data.size());
+}
+
 struct CachedSourceWrapper
 {
     CachedSource<MemoryViewSource> impl{gDefaultSource};
@@ -660,6 +2190,7 @@ struct CachedSourceWrapper
 using SourceTypes = ::testing::Types<HttpSourceWrapper,
                                      MemoryViewSourceWrapper,
                                      FileSourceWrapper,
+                                     MappedFileSourceWrapper,
                                      CachedSourceWrapper>;
 TYPED_TEST_SUITE(SourceTestF, SourceTypes);
 
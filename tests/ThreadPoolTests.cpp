@@ -0,0 +1,73 @@
+#include <vd/ThreadPool.h>
+#include <vd/Errors.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+
+using namespace std::chrono_literals;
+using namespace vd;
+
+namespace
+{
+
+TEST(ThreadPoolTests, RunsTasksInOrderOfSubmission)
+{
+    auto order = std::vector<int>{};
+    auto futures = std::vector<std::future<void>>{};
+    {
+        auto pool = ThreadPool{1};
+        for(int i = 0; i < 10; ++i)
+        {
+            futures.push_back(pool.Submit(0, [&order, i](std::size_t) { order.push_back(i); }));
+        }
+
+        futures.push_back(pool.Submit(0, [](std::size_t) { throw Error{"failed"}; }));
+        ASSERT_THROW(pool.Submit(1, [](std::size_t) {}), RangeError);
+    }
+
+    ASSERT_EQ((std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), order);
+    ASSERT_THROW(futures.back().get(), Error);
+}
+
+TEST(ThreadPoolTests, IdleWorkerStealsTasks)
+{
+    auto pool = ThreadPool{2};
+    auto promise = std::promise<std::size_t>{};
+    auto stolen = promise.get_future();
+
+    //Second task is queued behind blocked first one, so it can be run only
+    //by other worker
+    auto first = pool.Submit(0,
+                             [&stolen](std::size_t)
+                             {
+                                 if(stolen.wait_for(10s) != std::future_status::ready)
+                                 {
+                                     throw Error{"task isn't stolen"};
+                                 }
+                             });
+    auto second = pool.Submit(0, [&promise](std::size_t worker) { promise.set_value(worker); });
+
+    first.get();
+    second.get();
+    ASSERT_EQ(1, stolen.get());
+}
+
+TEST(ThreadPoolTests, ScalesPastManyWorkers)
+{
+    auto counter = std::atomic<std::size_t>{0};
+    {
+        auto pool = ThreadPool{300};
+        ASSERT_EQ(300, pool.NumThreads());
+        for(std::size_t i = 0; i < 1000; ++i)
+        {
+            pool.Submit(i % 300, [&counter](std::size_t) { ++counter; });
+        }
+    }
+
+    ASSERT_EQ(1000, counter);
+    ASSERT_THROW(ThreadPool{0}, ArgumentError);
+}
+
+}//unnamed namespace
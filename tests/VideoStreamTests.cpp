@@ -102,7 +102,7 @@ protected:
                 new Source{FileSource{gSquaresFilePath}}};
         stream =
             OpenMediaSource(
-                [&source]() { return std::make_unique<Reader>(source); });
+                [source]() { return std::make_unique<Reader>(source); });
     }
 
     std::optional<VideoStream> stream;    
@@ -248,4 +248,112 @@ TEST_F(VideoStreamTestF, NormalReadingAfterSeeking)
     ASSERT_EQ(gRgbaImg2, frame.RgbaImage());
 }
 
+TEST(ProbedMediaTests, StreamsShareProbedMedia)
+{
+    auto source =
+        std::shared_ptr<SourceBase>{
+            new Source{FileSource{gSquaresFilePath}}};
+    auto factory = [source]() { return std::make_unique<Reader>(source); };
+
+    auto params = OpeningParams{};
+    params.probed = ProbeMediaSource(factory);
+
+    auto first = OpenMediaSource(factory, params);
+    auto second = OpenMediaSource(factory, params);
+
+    auto frame = *first.NextFrame(4850ms);
+    ASSERT_EQ(4800ms, frame.Timestamp());
+    ASSERT_EQ(gRgbaImg1, frame.RgbaImage());
+
+    frame = *second.NextFrame(10050ms);
+    ASSERT_EQ(10000ms, frame.Timestamp());
+    ASSERT_EQ(gRgbaImg3, frame.RgbaImage());
+}
+
+TEST(ProbedMediaTests, SavedProbedMediaIsLoaded)
+{
+    auto source =
+        std::shared_ptr<SourceBase>{
+            new Source{FileSource{gSquaresFilePath}}};
+    auto factory = [source]() { return std::make_unique<Reader>(source); };
+
+    auto nameBuf = std::tmpnam(nullptr);
+    ASSERT_NE(nullptr, nameBuf);
+    auto path = std::filesystem::temp_directory_path() / nameBuf;
+    Defer remove{
+        [&path]()
+        {
+            auto ec = std::error_code{};
+            std::filesystem::remove(path, ec);
+        }};
+
+    ASSERT_EQ(nullptr, LoadProbedMedia(path));
+    SaveProbedMedia(path, *ProbeMediaSource(factory));
+
+    auto params = OpeningParams{};
+    params.probed = LoadProbedMedia(path);
+    ASSERT_NE(nullptr, params.probed);
+
+    auto stream = OpenMediaSource(factory, params);
+    auto frame = *stream.NextFrame(10050ms);
+    ASSERT_EQ(10000ms, frame.Timestamp());
+    ASSERT_EQ(gRgbaImg3, frame.RgbaImage());
+
+    //Truncated file is rejected
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    ASSERT_EQ(nullptr, LoadProbedMedia(path));
+}
+
+TEST(VideoStreamTests, DecoderThreadsAndName)
+{
+    auto source =
+        std::shared_ptr<SourceBase>{
+            new Source{FileSource{gSquaresFilePath}}};
+    auto factory = [source]() { return std::make_unique<Reader>(source); };
+
+    auto params = OpeningParams{};
+    params.decoderThreads = 4;
+    auto stream = OpenMediaSource(factory, params);
+    auto frame = *stream.NextFrame(10050ms);
+    ASSERT_EQ(10000ms, frame.Timestamp());
+    ASSERT_EQ(gRgbaImg3, frame.RgbaImage());
+
+    params.decoderName = "nonexistent";
+    ASSERT_THROW(OpenMediaSource(factory, params), NotFoundError);
+}
+
+//Keyframes of squares.mp4 (sync samples of its stss box) are at 0s, 5s and
+//10s, so seeking context is opened only when keyframe lies ahead
+TEST(VideoStreamTests, SeekingContextIsCreatedLazily)
+{
+    auto source =
+        std::shared_ptr<SourceBase>{
+            new Source{FileSource{gSquaresFilePath}}};
+    auto numCreated = std::make_shared<std::size_t>(0);
+    auto factory =
+        [source, numCreated]()
+        {
+            ++*numCreated;
+            return std::make_unique<Reader>(source);
+        };
+
+    auto stream = OpenMediaSource(factory);
+    auto numOpened = *numCreated;
+
+    ASSERT_EQ(1000ms, stream.NextFrame(1050ms)->Timestamp());
+    //No keyframe in between, so frames are decoded further
+    ASSERT_EQ(4800ms, stream.NextFrame(4850ms)->Timestamp());
+    ASSERT_EQ(numOpened, *numCreated);
+
+    //Keyframe at 10s lies ahead of last returned frame, so stream seeks
+    auto frame = *stream.NextFrame(10050ms);
+    ASSERT_EQ(10000ms, frame.Timestamp());
+    ASSERT_EQ(gRgbaImg3, frame.RgbaImage());
+    ASSERT_EQ(numOpened + 1, *numCreated);
+
+    //Contexts are swapped, so the other one is reused
+    ASSERT_EQ(4800ms, stream.NextFrame(4850ms)->Timestamp());
+    ASSERT_EQ(numOpened + 1, *numCreated);
+}
+
 }//unnamed namespace
\ No newline at end of file